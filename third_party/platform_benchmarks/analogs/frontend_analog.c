@@ -0,0 +1,451 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Frontend stress analog. Like bigtable_analog, but the straight line code
+// is generated into an executable buffer at startup, so code footprint,
+// branch density and mix, data footprint and instructions per memory access
+// can be changed (and swept) without a recompile.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
+
+// Instructions per timed run, ~1 sec at a few BIPS.
+#define TARGET_INSTRUCTIONS (1llu << 31)
+#define SWEEP_MIN_KB 16
+#define SWEEP_MAX_KB (64 << 10)
+#define DATA_STRIDE 64
+#define BRANCH_SEED 1220
+
+// Room for the prologue, epilogue and the last instruction group.
+#define CODE_SLACK 64
+
+// Longest config_string(): two sizes, five 10 digit knobs and the labels.
+#define CONFIG_STRING_LENGTH 144
+// Room for the config in a result name, after "frontend_analog(" and ")".
+#define CONFIG_NAME_CHARS (FN_NAME_LENGTH - 18)
+
+struct Config {
+  uint64_t code_bytes;
+  uint64_t data_bytes;     // Power of 2.
+  unsigned branch_every;   // Instructions per branch, 0 for none.
+  unsigned taken;          // Relative weights of the branch kinds.
+  unsigned not_taken;
+  unsigned indirect;
+  unsigned insts_per_mem;  // Instructions per memory access, 0 for none.
+};
+
+struct Emitter {
+  uint8_t* buf;
+  uint64_t pos;
+  uint64_t insts;  // Executed per call.
+};
+
+// data[*offset] onwards is walked DATA_STRIDE bytes at a time, wrapping at
+// mask. Returns a sum of the loaded values and leaves *offset where it
+// stopped, so consecutive calls cover the whole data footprint.
+typedef uint64_t (*GeneratedCode)(char* data, uint64_t* offset, uint64_t mask);
+
+enum BranchKind {
+  branch_taken,
+  branch_not_taken,
+  branch_indirect,
+};
+
+#if defined(__x86_64__)
+
+// Register use: rdi data, rsi offset, rdx mask, r11 offset pointer,
+// rax accumulator, r8-r10 filler, rcx indirect target.
+
+// add (%rdi,%rsi,1), %rax; add $64, %rsi; and %rdx, %rsi
+#define MEM_GROUP_INSTS 3
+
+static void emit_bytes(struct Emitter* e, const uint8_t* bytes, const int n) {
+  memcpy(e->buf + e->pos, bytes, n);
+  e->pos += n;
+}
+
+static void emit_rel32(struct Emitter* e, const int32_t rel) {
+  memcpy(e->buf + e->pos, &rel, sizeof(rel));
+  e->pos += sizeof(rel);
+}
+
+static void emit_prologue(struct Emitter* e) {
+  static const uint8_t code[] = {
+    0x49, 0x89, 0xf3,  // mov %rsi, %r11
+    0x49, 0x8b, 0x33,  // mov (%r11), %rsi
+    0x31, 0xc0,        // xor %eax, %eax
+  };
+  emit_bytes(e, code, sizeof(code));
+  e->insts += 3;
+}
+
+static void emit_epilogue(struct Emitter* e) {
+  static const uint8_t code[] = {
+    0x49, 0x89, 0x33,  // mov %rsi, (%r11)
+    0xc3,              // ret
+  };
+  emit_bytes(e, code, sizeof(code));
+  e->insts += 2;
+}
+
+static void emit_mem(struct Emitter* e) {
+  static const uint8_t code[] = {
+    0x48, 0x03, 0x04, 0x37,  // add (%rdi,%rsi,1), %rax
+    0x48, 0x83, 0xc6, DATA_STRIDE,  // add $64, %rsi
+    0x48, 0x21, 0xd6,        // and %rdx, %rsi
+  };
+  emit_bytes(e, code, sizeof(code));
+  e->insts += MEM_GROUP_INSTS;
+}
+
+// add $1, %r8 / %r9 / %r10, rotating to keep dependency chains short.
+static void emit_filler(struct Emitter* e, const int k) {
+  const uint8_t code[] = {0x49, 0x83, (uint8_t)(0xc0 + k % 3), 0x01};
+  emit_bytes(e, code, sizeof(code));
+  e->insts += 1;
+}
+
+static void emit_branch(struct Emitter* e, const enum BranchKind kind) {
+  static const uint8_t test[] = {0x48, 0x85, 0xff};  // test %rdi, %rdi
+  static const uint8_t jnz[] = {0x0f, 0x85};
+  static const uint8_t jz[] = {0x0f, 0x84};
+  static const uint8_t lea[] = {0x48, 0x8d, 0x0d};   // lea rel(%rip), %rcx
+  static const uint8_t jmp_rcx[] = {0xff, 0xe1};     // jmp *%rcx
+  static const uint8_t int3 = 0xcc;                  // Never executed.
+
+  switch (kind) {
+    case branch_taken:  // data is never NULL.
+      emit_bytes(e, test, sizeof(test));
+      emit_bytes(e, jnz, sizeof(jnz));
+      emit_rel32(e, 1);
+      emit_bytes(e, &int3, 1);
+      break;
+
+    case branch_not_taken:
+      emit_bytes(e, test, sizeof(test));
+      emit_bytes(e, jz, sizeof(jz));
+      emit_rel32(e, 0);
+      break;
+
+    case branch_indirect:
+      emit_bytes(e, lea, sizeof(lea));
+      emit_rel32(e, sizeof(jmp_rcx) + 1);
+      emit_bytes(e, jmp_rcx, sizeof(jmp_rcx));
+      emit_bytes(e, &int3, 1);
+      break;
+  }
+  e->insts += 2;
+}
+
+#elif defined(__aarch64__)
+
+// Register use: x0 data, x1 offset pointer, x2 mask, x3 offset,
+// x4 accumulator, x5 loaded value, x9-x11 filler, x8 indirect target.
+
+// ldr x5, [x0, x3]; add x4, x4, x5; add x3, x3, #64; and x3, x3, x2
+#define MEM_GROUP_INSTS 4
+
+static void emit_inst(struct Emitter* e, const uint32_t inst) {
+  memcpy(e->buf + e->pos, &inst, sizeof(inst));
+  e->pos += sizeof(inst);
+}
+
+static void emit_prologue(struct Emitter* e) {
+  emit_inst(e, 0xf9400023);  // ldr x3, [x1]
+  emit_inst(e, 0xd2800004);  // mov x4, #0
+  e->insts += 2;
+}
+
+static void emit_epilogue(struct Emitter* e) {
+  emit_inst(e, 0xf9000023);  // str x3, [x1]
+  emit_inst(e, 0xaa0403e0);  // mov x0, x4
+  emit_inst(e, 0xd65f03c0);  // ret
+  e->insts += 3;
+}
+
+static void emit_mem(struct Emitter* e) {
+  emit_inst(e, 0xf8636805);  // ldr x5, [x0, x3]
+  emit_inst(e, 0x8b050084);  // add x4, x4, x5
+  emit_inst(e, 0x91000063 | (DATA_STRIDE << 10));  // add x3, x3, #64
+  emit_inst(e, 0x8a020063);  // and x3, x3, x2
+  e->insts += MEM_GROUP_INSTS;
+}
+
+// add x9 / x10 / x11, #1, rotating to keep dependency chains short.
+static void emit_filler(struct Emitter* e, const int k) {
+  const uint32_t reg = 9 + k % 3;
+  emit_inst(e, 0x91000400 | (reg << 5) | reg);
+  e->insts += 1;
+}
+
+static void emit_branch(struct Emitter* e, const enum BranchKind kind) {
+  static const uint32_t brk = 0xd4200000;  // Never executed.
+
+  switch (kind) {
+    case branch_taken:  // x0 (data) is never NULL.
+      emit_inst(e, 0xb5000000 | (2 << 5));  // cbnz x0, .+8
+      emit_inst(e, brk);
+      e->insts += 1;
+      break;
+
+    case branch_not_taken:
+      emit_inst(e, 0xb4000000 | (1 << 5));  // cbz x0, .+4
+      e->insts += 1;
+      break;
+
+    case branch_indirect:
+      emit_inst(e, 0x10000068);  // adr x8, .+12
+      emit_inst(e, 0xd61f0100);  // br x8
+      emit_inst(e, brk);
+      e->insts += 2;
+      break;
+  }
+}
+
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+static uint64_t xorshift64(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static enum BranchKind pick_branch(const struct Config* c, uint64_t* state) {
+  const uint64_t r = xorshift64(state) % (c->taken + c->not_taken +
+                                          c->indirect);
+  if (r < c->taken) return branch_taken;
+  if (r < c->taken + c->not_taken) return branch_not_taken;
+  return branch_indirect;
+}
+
+// Fills buf (c->code_bytes + CODE_SLACK long) with the straight line code
+// for c. Returns instructions executed per call.
+static uint64_t generate(const struct Config* c, uint8_t* buf) {
+  struct Emitter e;
+  uint64_t state = BRANCH_SEED;
+  unsigned since_branch = 0;
+  unsigned since_mem = 0;
+  int k = 0;
+
+  e.buf = buf;
+  e.pos = 0;
+  e.insts = 0;
+  emit_prologue(&e);
+
+  while (e.pos < c->code_bytes) {
+    if (c->branch_every > 0 && since_branch >= c->branch_every) {
+      emit_branch(&e, pick_branch(c, &state));
+      since_branch = 0;
+    } else if (c->insts_per_mem > 0 &&
+               since_mem + MEM_GROUP_INSTS >= c->insts_per_mem) {
+      emit_mem(&e);
+      since_mem = 0;
+      since_branch += MEM_GROUP_INSTS;
+    } else {
+      emit_filler(&e, k++);
+      since_mem++;
+      since_branch++;
+    }
+  }
+
+  emit_epilogue(&e);
+  return e.insts;
+}
+
+#endif
+
+static void config_string(char* str, const struct Config* c) {
+  char code[MAX_BYTE_STRING_LENGTH];
+  char data[MAX_BYTE_STRING_LENGTH];
+  size2string(code, c->code_bytes);
+  size2string(data, c->data_bytes);
+  snprintf(str, CONFIG_STRING_LENGTH,
+           "code=%.*s, data=%.*s, branch_every=%u, branches=%u,%u,%u, "
+           "insts_per_mem=%u", BYTE_STRING_CHARS, code, BYTE_STRING_CHARS,
+           data, c->branch_every, c->taken, c->not_taken, c->indirect,
+           c->insts_per_mem);
+}
+
+struct Result frontend_analog(const struct Config* c) {
+  struct Result result;
+  char config[CONFIG_STRING_LENGTH];
+
+  result.metric = 0;
+  result.resulthash = 0;
+  strcpy(result.metricname, "BIPS");
+  config_string(config, c);
+
+#if defined(__x86_64__) || defined(__aarch64__)
+  const size_t code_len = c->code_bytes + CODE_SLACK;
+  uint8_t* code = (uint8_t*)mmap(NULL, code_len, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    perror("Unable to map code buffer\n");
+    exit(1);
+  }
+  const uint64_t insts_per_call = generate(c, code);
+  __builtin___clear_cache((char*)code, (char*)code + code_len);
+  if (mprotect(code, code_len, PROT_READ | PROT_EXEC) != 0) {
+    perror("Unable to make code buffer executable\n");
+    exit(1);
+  }
+
+  char* data;
+  if (posix_memalign((void **)&data, DATA_STRIDE, c->data_bytes) != 0) {
+    perror("Unable to allocate data\n");
+    exit(1);
+  }
+  memset(data, 1, c->data_bytes);
+
+  GeneratedCode fn = (GeneratedCode)code;
+  const uint64_t calls = (TARGET_INSTRUCTIONS > insts_per_call ?
+                          TARGET_INSTRUCTIONS / insts_per_call : 1);
+  uint64_t offset = 0;
+  uint64_t accum = fn(data, &offset, c->data_bytes - 1);  // Fault in, warm.
+  uint64_t i;
+
+  uint64_t t = now_nsec();
+  for (i = 0; i < calls; i++) {
+    accum += fn(data, &offset, c->data_bytes - 1);
+  }
+  t = now_nsec() - t;
+
+  result.metric = (double)(insts_per_call * calls) / t;
+  result.resulthash = accum;
+  // Only knobs in the billions don't fit.
+  snprintf(result.function, FN_NAME_LENGTH, "%s(%.*s)", __FUNCTION__,
+           CONFIG_NAME_CHARS, config);
+
+  free(data);
+  munmap(code, code_len);
+#else
+  snprintf(result.function, FN_NAME_LENGTH,
+           "%s(%.*s) NOT APPLICABLE on Current Platform", __FUNCTION__,
+           CONFIG_NAME_CHARS - 35, config);
+#endif
+  return result;
+}
+
+static void print_result(const struct Result* r) {
+  printf("%s %s=%.4f\n", r->function, r->metricname, r->metric);
+  fflush(stdout);
+}
+
+void helpinfo() {
+  printf("%40s\t%s\n", "--code_kb K",
+         "Generated code footprint in KB (default 11264, as bigtable_analog)");
+  printf("%40s\t%s\n", "--data_kb D",
+         "Data footprint in KB, rounded up to a power of 2 (default 16384)");
+  printf("%40s\t%s\n", "--branch_every N",
+         "One branch per N instructions, 0 for none (default 34)");
+  printf("%40s\t%s\n", "--branches T,N,I",
+         "Relative weights of taken, not-taken and indirect branches "
+         "(default 1,0,0)");
+  printf("%40s\t%s\n", "--insts_per_mem M",
+         "Instructions per data access, 0 for none (default and minimum: "
+         "the access itself plus offset update and wrap)");
+  printf("%40s\t%s\n", "--run", "BIPS for the current configuration");
+  printf("%40s\t%s\n", "--sweep",
+         "BIPS for code footprints from 16KB to 64MB");
+}
+
+static uint64_t next_power_of_2(const uint64_t n) {
+  uint64_t p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+int main(int argc, char* argv[]) {
+  struct Config c;
+  int i;
+
+  c.code_bytes = 11264llu << 10;
+  c.data_bytes = 16384llu << 10;
+  c.branch_every = 34;
+  c.taken = 1;
+  c.not_taken = 0;
+  c.indirect = 0;
+#ifdef MEM_GROUP_INSTS
+  c.insts_per_mem = MEM_GROUP_INSTS;
+#else
+  c.insts_per_mem = 0;
+#endif
+
+  if (argc == 1) {
+    helpinfo();
+    return 0;
+  }
+
+  for (i = 1; i < argc;) {
+    if (strcmp(argv[i], "--help") == 0) {
+      helpinfo();
+      break;
+    }
+    if (strcmp(argv[i], "--run") == 0) {
+      struct Result r = frontend_analog(&c);
+      print_result(&r);
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "--sweep") == 0) {
+      const uint64_t code_bytes = c.code_bytes;
+      uint64_t kb;
+      for (kb = SWEEP_MIN_KB; kb <= SWEEP_MAX_KB; kb *= 2) {
+        c.code_bytes = kb << 10;
+        struct Result r = frontend_analog(&c);
+        print_result(&r);
+      }
+      c.code_bytes = code_bytes;
+      i++;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Unknown or incomplete option %s\n", argv[i]);
+      exit(1);
+    }
+    const uint64_t value = strtoull(argv[i + 1], NULL, 0);
+    if (strcmp(argv[i], "--code_kb") == 0 && value > 0) {
+      c.code_bytes = value << 10;
+    } else if (strcmp(argv[i], "--data_kb") == 0 && value > 0) {
+      c.data_bytes = next_power_of_2(value << 10);
+    } else if (strcmp(argv[i], "--branch_every") == 0) {
+      c.branch_every = value;
+    } else if (strcmp(argv[i], "--branches") == 0) {
+      if (sscanf(argv[i + 1], "%u,%u,%u", &c.taken, &c.not_taken,
+                 &c.indirect) != 3 ||
+          c.taken + c.not_taken + c.indirect == 0) {
+        fprintf(stderr, "--branches needs T,N,I weights, eg: 2,1,1\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--insts_per_mem") == 0) {
+      c.insts_per_mem = value;
+    } else {
+      fprintf(stderr, "Unknown option %s %s\n", argv[i], argv[i + 1]);
+      exit(1);
+    }
+    i += 2;
+  }
+  return 0;
+}
@@ -14,29 +14,66 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "third_party/platform_benchmarks/analogs/exegesis_memcpy.h"
 #include "third_party/platform_benchmarks/analogs/local_memcpy.h"
 #include "third_party/platform_benchmarks/analogs/memcpy_analog.h"
+#include "third_party/platform_benchmarks/analogs/memcpy_profile.h"
 #include "third_party/platform_benchmarks/result.h"
 #include "third_party/platform_benchmarks/util.h"
 #include "third_party/platform_benchmarks/x86_primitives.h"
 
-#define MBPS(bytes,ns) ((double)((bytes>>20)*1000000000)/ns)
+#define MBPS(bytes,ns) ((double)(bytes) / (1 << 20) * 1000000000 / (ns))
+
+// Buckets of the per-size breakdown: bucket 0 is size 0, bucket k holds
+// sizes [2^(k-1), 2^k).
+#define NUM_BUCKETS 48
+#define BUCKET_MIN(k) ((k) == 0 ? 0 : 1llu << ((k) - 1))
+#define BUCKET_MAX(k) ((k) == 0 ? 0 : (1llu << (k)) - 1)
+
+// Random replay draws this many calls from the profile up front and cycles
+// through them, too many for the branch predictors to learn the order.
+#define SCHEDULE_LENGTH LOOP1M
+#define DEFAULT_CALLS LOOP16M
+#define DEFAULT_POOL_MB 1024
+#define SCHEDULE_SEED 1220
 
 const int cacheline_size = 64;
 
-enum VariantType {
-  test_repmovs,
-  test_memcpy,
+enum MemOp {
+  op_copy,
+  op_move,     // dst overlaps src, one cacheline above it.
+  op_set,      // Writes dst only.
+  op_compare,  // Equal buffers, so every byte gets compared.
 };
 
 struct Variant {
   const char* flag;
   const char* name;
   const char* helpinfo;
+  enum MemOp op;
+  // Times outer_loop_count back to back calls with the same arguments.
   uint64_t (*function)();
+  // A single call, for randomized replay.
+  void (*call)(char* dst, char* src, size_t n);
 };
 
+struct Options {
+  int random;
+  uint64_t calls;
+  uint64_t pool_bytes;
+};
+
+struct Bucket {
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t ns;
+};
+
+static volatile int memcmp_sink;
 
 uint64_t rep_movs_time(uint64_t outer_loop_count,
                        uint64_t copy_bytes,
@@ -49,6 +86,29 @@ uint64_t rep_movs_time(uint64_t outer_loop_count,
   return now_nsec() - t;
 }
 
+uint64_t rep_stos_time(uint64_t outer_loop_count,
+                       uint64_t copy_bytes,
+                       uint64_t src_pointer,
+                       uint64_t dst_pointer) {
+  (void)src_pointer;  // Same signature as the copies.
+  uint64_t t = now_nsec();
+
+  asm volatile("cld\n\t"
+               "test %[loop_counter], %[loop_counter]\n\t"
+               ".align 64\n\t"
+               "1: jz 1f\n\t"
+               "mov %[dst], %%rdi\n\t"
+               "mov %[count], %%rcx\n\t"
+               "rep stosb\n\t"
+               "dec %[loop_counter]\n\t"
+               "jmp 1b\n\t"
+               "1: nop\n\t"
+               : [loop_counter]"+r"(outer_loop_count)
+               : [dst]"r"(dst_pointer), [count]"r"(copy_bytes), "a"(0x5a)
+               : "%rcx", "%rdi", "cc", "memory");
+  return now_nsec() - t;
+}
+
 uint64_t memcpy_time(uint64_t outer_loop_count,
                      uint64_t copy_bytes,
                      uint64_t src_pointer,
@@ -103,58 +163,212 @@ uint64_t exegesis_memcpy_time(uint64_t outer_loop_count,
   return now_nsec() - t;
 }
 
-#define NUMTESTS 4
+uint64_t memmove_time(uint64_t outer_loop_count,
+                      uint64_t copy_bytes,
+                      uint64_t src_pointer,
+                      uint64_t dst_pointer) {
+  void* srcptr = (void *)src_pointer;
+  void* dstptr = (void *)dst_pointer;
+  size_t n = (size_t)copy_bytes;
+
+  uint64_t t = now_nsec();
+
+  uint64_t i;
+  for (i = 0; i < outer_loop_count; i++) {
+    memmove(dstptr, srcptr, n);
+    asm volatile("" ::: "memory");
+  }
+
+  return now_nsec() - t;
+}
+
+uint64_t memset_time(uint64_t outer_loop_count,
+                     uint64_t copy_bytes,
+                     uint64_t src_pointer,
+                     uint64_t dst_pointer) {
+  void* dstptr = (void *)dst_pointer;
+  size_t n = (size_t)copy_bytes;
+  (void)src_pointer;  // Same signature as the copies.
+
+  uint64_t t = now_nsec();
+
+  uint64_t i;
+  for (i = 0; i < outer_loop_count; i++) {
+    memset(dstptr, 0x5a, n);
+    asm volatile("" ::: "memory");
+  }
+
+  return now_nsec() - t;
+}
+
+uint64_t memcmp_time(uint64_t outer_loop_count,
+                     uint64_t copy_bytes,
+                     uint64_t src_pointer,
+                     uint64_t dst_pointer) {
+  void* srcptr = (void *)src_pointer;
+  void* dstptr = (void *)dst_pointer;
+  size_t n = (size_t)copy_bytes;
+
+  uint64_t t = now_nsec();
+
+  uint64_t i;
+  for (i = 0; i < outer_loop_count; i++) {
+    memcmp_sink += memcmp(dstptr, srcptr, n);
+  }
+
+  return now_nsec() - t;
+}
+
+static void rep_movs_call(char* dst, char* src, size_t n) {
+  asm volatile("rep movsb\n\t" : "+D"(dst), "+S"(src), "+c"(n) :: "memory");
+}
+
+static void rep_stos_call(char* dst, char* src, size_t n) {
+  (void)src;
+  asm volatile("rep stosb\n\t" : "+D"(dst), "+c"(n) : "a"(0x5a) : "memory");
+}
+
+static void memcpy_call(char* dst, char* src, size_t n) {
+  memcpy(dst, src, n);
+}
+
+static void google3_strings_memcpy_call(char* dst, char* src, size_t n) {
+  google3_strings_memcpy(dst, src, n);
+}
+
+static void exegesis_memcpy_call(char* dst, char* src, size_t n) {
+  exegesis_memcpy(dst, src, n);
+}
+
+static void memmove_call(char* dst, char* src, size_t n) {
+  memmove(dst, src, n);
+}
+
+static void memset_call(char* dst, char* src, size_t n) {
+  (void)src;
+  memset(dst, 0x5a, n);
+}
+
+static void memcmp_call(char* dst, char* src, size_t n) {
+  memcmp_sink += memcmp(dst, src, n);
+}
+
+#define NUMTESTS 8
 const struct Variant alltests[NUMTESTS] = {
-  {"--repmovs", "repmovs", "rep movs performance", rep_movs_time},
-  {"--memcpy", "memcpy", "memcpy performance", memcpy_time},
+  {"--repmovs", "repmovs", "rep movs performance", op_copy,
+   rep_movs_time, rep_movs_call},
+  {"--memcpy", "memcpy", "memcpy performance", op_copy,
+   memcpy_time, memcpy_call},
   {"--google3_strings_memcpy",
    "google3_strings_memcpy",
    "cs/strings/fastmem.h \"memcpy_inlined\" performance",
-   google3_strings_memcpy_time},
+   op_copy,
+   google3_strings_memcpy_time, google3_strings_memcpy_call},
   {"--google3_memcpy", "exegesis_memcpy", "exegesis memcpy performance",
-   exegesis_memcpy_time},
+   op_copy, exegesis_memcpy_time, exegesis_memcpy_call},
+  {"--memmove", "memmove", "overlapping memmove performance", op_move,
+   memmove_time, memmove_call},
+  {"--memset", "memset", "memset performance", op_set,
+   memset_time, memset_call},
+  {"--repstos", "repstos", "rep stos performance", op_set,
+   rep_stos_time, rep_stos_call},
+  {"--memcmp", "memcmp", "memcmp (equal buffers) performance", op_compare,
+   memcmp_time, memcmp_call},
 };
 
-struct Result search_memcpy_analog(const struct Variant* t) {
+static int bucket_of(const uint64_t bytes) {
+  return bytes == 0 ? 0 : 64 - __builtin_clzll(bytes);
+}
+
+// src and dst of entry e within a slot starting at base. Returns the bytes
+// of the slot used.
+static uint64_t place(const struct Variant* t,
+                      const struct MemcpyProfile* e,
+                      char* base,
+                      char** src,
+                      char** dst) {
+  *src = base + e->src_mod_64;
+  if (t->op == op_move) {
+    *dst = base + cacheline_size + e->dst_mod_64;
+  } else {
+    // dst starts on a cacheline separate from src copy range.
+    *dst = base + ((e->src_mod_64 + e->copy_bytes) / cacheline_size + 1) *
+           cacheline_size + e->dst_mod_64;
+  }
+  return *dst + e->copy_bytes - base;
+}
+
+static uint64_t max_copy_bytes(const struct Profile* profile) {
+  uint64_t max = 0;
+  uint64_t p;
+  for (p = 0; p < profile->count; p++) {
+    if (profile->entries[p].copy_bytes > max) {
+      max = profile->entries[p].copy_bytes;
+    }
+  }
+  return max;
+}
+
+static void print_buckets(const struct Variant* t,
+                          const struct Bucket* buckets) {
+  int k;
+  for (k = 0; k < NUM_BUCKETS; k++) {
+    if (buckets[k].calls == 0 || buckets[k].ns == 0) continue;
+    printf("%s: bytes=%llu-%llu calls=%llu ns_per_call=%.2f MBPS=%.4f\n",
+           t->name, BUCKET_MIN(k), BUCKET_MAX(k),
+           (unsigned long long)buckets[k].calls,
+           (double)buckets[k].ns / buckets[k].calls,
+           MBPS(buckets[k].bytes, buckets[k].ns));
+  }
+}
+
+// Replays each profile entry's calls back to back, in profile order.
+struct Result search_memcpy_analog(const struct Variant* t,
+                                   const struct Profile* profile) {
   struct Result result;
+  struct Bucket buckets[NUM_BUCKETS];
 
   void *m;
+  const uint64_t max_bytes = max_copy_bytes(profile);
 
   if (posix_memalign(&m, cacheline_size,
-                     LOOP4M * 2 + 2 * cacheline_size) != 0) {
+                     max_bytes * 2 + 3 * cacheline_size) != 0) {
     perror("Unable to align to cacheline size\n");
+    exit(1);
   }
+  memset(m, 0x5a, max_bytes * 2 + 3 * cacheline_size);
+  memset(buckets, 0, sizeof(buckets));
 
   uint64_t total_time = 0;
   uint64_t last_total_time = 0;
   uint64_t total_copy_bytes = 0;
-  int num_profile_entries = (sizeof(muppet_profile_cl193114178) /
-                             sizeof(muppet_profile_cl193114178[0]));
-  const struct MemcpyProfile* profile = muppet_profile_cl193114178;
+  uint64_t total_calls = 0;
+  const uint64_t num_profile_entries = profile->count;
 
-  uint64_t src_pointer;
-  uint64_t dst_pointer;
+  char* src;
+  char* dst;
   uint64_t copy_bytes;
   uint64_t outer_loop_count;
 
-  int p;
+  uint64_t p;
   for (p = 0; p < num_profile_entries; p++) {
-    copy_bytes = profile[p].copy_bytes;
-    total_copy_bytes += copy_bytes;
-    outer_loop_count = profile[p].copy_count;
-    src_pointer = ((uint64_t)m + profile[p].src_mod_64);
-
-    // dst_pointer starts on a cacheline separate from src copy range.
-    dst_pointer = ((uint64_t)m +
-                   ((profile[p].src_mod_64 + copy_bytes) /
-                    cacheline_size
-                    + 1) *
-                   cacheline_size +
-                   profile[p].dst_mod_64);
+    const struct MemcpyProfile* e = &profile->entries[p];
+    copy_bytes = e->copy_bytes;
+    outer_loop_count = e->copy_count;
+    total_copy_bytes += copy_bytes * outer_loop_count;
+    total_calls += outer_loop_count;
+    place(t, e, (char*)m, &src, &dst);
+
     uint64_t (*variant)() = t->function;
-    uint64_t elapsed_nsec = variant(outer_loop_count, copy_bytes, src_pointer, dst_pointer);
+    uint64_t elapsed_nsec = variant(outer_loop_count, copy_bytes,
+                                    (uint64_t)src, (uint64_t)dst);
     total_time += elapsed_nsec;
 
+    struct Bucket* b = &buckets[bucket_of(copy_bytes)];
+    b->calls += e->copy_count;
+    b->bytes += copy_bytes * e->copy_count;
+    b->ns += elapsed_nsec;
+
     if ((total_time>>33) != (last_total_time>>33)) {
       printf("%s(%s): progress=%.0f%% seconds=%.0f MBPS=%.4f\n",
              __FUNCTION__, t->name, (double)(p*100)/num_profile_entries,
@@ -162,15 +376,191 @@ struct Result search_memcpy_analog(const struct Variant* t) {
     }
     last_total_time = total_time;
   }
+  print_buckets(t, buckets);
+  free(m);
 
+  result.resulthash = total_calls;
+  strcpy(result.metricname, "MBPS");
+  if (total_calls == 0 || total_time == 0) {
+    result.metric = 0;
+    sprintf(result.function, "%s(%s) profile has no calls", __FUNCTION__,
+            t->name);
+    return result;
+  }
   result.metric = MBPS(total_copy_bytes, total_time);
+  sprintf(result.function, "%s(%s, %.2f ns_per_call)", __FUNCTION__, t->name,
+          (double)total_time / total_calls);
+  return result;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// SCHEDULE_LENGTH entry indices drawn from the profile, weighted by
+// copy_count.
+static uint32_t* draw_schedule(const struct Profile* profile) {
+  uint64_t state = SCHEDULE_SEED;
+  uint64_t total = 0;
+  uint64_t p, i;
+
+  if (profile->count > UINT32_MAX) {
+    fprintf(stderr, "Random replay supports up to 2^32 profile entries\n");
+    exit(1);
+  }
+  uint64_t* cdf = (uint64_t*)malloc(sizeof(uint64_t) * profile->count);
+  uint32_t* schedule = (uint32_t*)malloc(sizeof(uint32_t) * SCHEDULE_LENGTH);
+  if (cdf == NULL || schedule == NULL) {
+    perror("Unable to allocate replay schedule\n");
+    exit(1);
+  }
+  for (p = 0; p < profile->count; p++) {
+    total += profile->entries[p].copy_count;
+    cdf[p] = total;
+  }
+  if (total == 0) {
+    fprintf(stderr, "Profile has no calls\n");
+    exit(1);
+  }
+  for (i = 0; i < SCHEDULE_LENGTH; i++) {
+    const uint64_t r = xorshift64(&state) % total;
+    uint64_t lo = 0;
+    uint64_t hi = profile->count - 1;
+    while (lo < hi) {  // First entry with cdf > r.
+      const uint64_t mid = (lo + hi) / 2;
+      if (cdf[mid] > r) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    schedule[i] = lo;
+  }
+  free(cdf);
+  return schedule;
+}
+
+// Makes calls calls, cycling through the length entries of schedule and
+// rotating through the pool. Returns elapsed ns and the bytes processed.
+static uint64_t replay(const struct Variant* t,
+                       const struct Profile* profile,
+                       const uint32_t* schedule,
+                       const uint64_t length,
+                       const uint64_t calls,
+                       char* pool,
+                       const uint64_t pool_bytes,
+                       uint64_t* bytes) {
+  uint64_t offset = 0;
+  uint64_t total = 0;
+  uint64_t i;
+  char* src;
+  char* dst;
+
+  uint64_t t0 = now_nsec();
+  for (i = 0; i < calls; i++) {
+    const struct MemcpyProfile* e = &profile->entries[schedule[i % length]];
+    uint64_t used = place(t, e, pool + offset, &src, &dst);
+    if (offset + used > pool_bytes) {
+      offset = 0;
+      used = place(t, e, pool, &src, &dst);
+    }
+    t->call(dst, src, e->copy_bytes);
+    total += e->copy_bytes;
+    offset += (used + cacheline_size - 1) & ~(uint64_t)(cacheline_size - 1);
+  }
+  t0 = now_nsec() - t0;
+  *bytes = total;
+  return t0;
+}
+
+// Interleaves calls in random order drawn from the profile and rotates
+// through a buffer pool larger than the LLC, so that caches and branch
+// predictors see something like production. Timing every call would swamp
+// the small ones, so the per-size breakdown instead replays each bucket's
+// entries of the schedule once, on their own: its numbers are for that size
+// in isolation, not its share of the interleaved run.
+struct Result random_memcpy_analog(const struct Variant* t,
+                                   const struct Profile* profile,
+                                   const struct Options* options) {
+  struct Result result;
+  struct Bucket buckets[NUM_BUCKETS];
+  uint64_t bytes;
+  uint64_t i;
+  int k;
+
+  const uint64_t slot = max_copy_bytes(profile) * 2 + 3 * cacheline_size;
+  const uint64_t pool_bytes = (options->pool_bytes > 4 * slot ?
+                               options->pool_bytes : 4 * slot);
+  void* pool;
+  if (posix_memalign(&pool, cacheline_size, pool_bytes) != 0) {
+    perror("Unable to allocate buffer pool\n");
+    exit(1);
+  }
+  memset(pool, 0x5a, pool_bytes);
+
+  uint32_t* schedule = draw_schedule(profile);
+  uint32_t* subset = (uint32_t*)malloc(sizeof(uint32_t) * SCHEDULE_LENGTH);
+  if (subset == NULL) {
+    perror("Unable to allocate replay schedule\n");
+    exit(1);
+  }
+
+  // One untimed pass to fault in the pool and warm up.
+  replay(t, profile, schedule, SCHEDULE_LENGTH, SCHEDULE_LENGTH,
+         (char*)pool, pool_bytes, &bytes);
+  const uint64_t total_time = replay(t, profile, schedule, SCHEDULE_LENGTH,
+                                     options->calls, (char*)pool, pool_bytes,
+                                     &bytes);
+
+  memset(buckets, 0, sizeof(buckets));
+  for (k = 0; k < NUM_BUCKETS; k++) {
+    uint64_t n = 0;
+    for (i = 0; i < SCHEDULE_LENGTH; i++) {
+      if (bucket_of(profile->entries[schedule[i]].copy_bytes) == k) {
+        subset[n++] = schedule[i];
+      }
+    }
+    if (n == 0) continue;
+    // One pass, so that all buckets together cost one schedule's worth of
+    // calls rather than another options->calls.
+    buckets[k].calls = n;
+    buckets[k].ns = replay(t, profile, subset, n, n, (char*)pool,
+                           pool_bytes, &buckets[k].bytes);
+  }
+  print_buckets(t, buckets);
+
+  free(subset);
+  free(schedule);
+  free(pool);
+
+  char poolstr[MAX_BYTE_STRING_LENGTH];
+  size2string(poolstr, pool_bytes);
+  result.metric = MBPS(bytes, total_time);
+  result.resulthash = bytes;
   strcpy(result.metricname, "MBPS");
-  sprintf(result.function, "%s(%s)",__FUNCTION__,t->name);
+  snprintf(result.function, FN_NAME_LENGTH,
+           "%s(%s, %.*s pool, %.2f ns_per_call)", __FUNCTION__,
+           t->name, BYTE_STRING_CHARS, poolstr,
+           (double)total_time / options->calls);
   return result;
 }
 
 void helpinfo() {
   int i;
+  printf("%40s\t%s\n", "--profile file",
+         "Size profile for the following variants, CSV or binary "
+         "(default: built in synthetic profile)");
+  printf("%40s\t%s\n", "--write_profile file",
+         "Write the current profile in the mmappable binary format");
+  printf("%40s\t%s\n", "--replay sequential|random",
+         "Replay each entry back to back (default), or interleave calls "
+         "in random order over a buffer pool");
+  printf("%40s\t%s\n", "--calls N", "Calls per random replay (default 16M)");
+  printf("%40s\t%s\n", "--pool_mb M",
+         "Random replay buffer pool, larger than the LLC (default 1024)");
   for (i = 0; i < NUMTESTS; i++) {
     printf("%40s\t%s\n", alltests[i].flag, alltests[i].helpinfo);
   }
@@ -178,19 +568,73 @@ void helpinfo() {
 
 
 int main(int argc, char* argv[]) {
+  struct Profile profile;
+  struct Options options;
   int i;
+
+  default_memcpy_profile(&profile);
+  options.random = 0;
+  options.calls = DEFAULT_CALLS;
+  options.pool_bytes = (uint64_t)DEFAULT_POOL_MB << 20;
+
   for (i=1; i < argc;) {
     if (strcmp(argv[i], "--help")==0) {
       helpinfo();
       break;
     }
+    if (i + 1 < argc) {
+      if (strcmp(argv[i], "--profile") == 0) {
+        free_memcpy_profile(&profile);
+        load_memcpy_profile(argv[i + 1], &profile);
+        i += 2;
+        continue;
+      }
+      if (strcmp(argv[i], "--write_profile") == 0) {
+        if (write_memcpy_profile(argv[i + 1], &profile) != 0) {
+          perror(argv[i + 1]);
+          exit(1);
+        }
+        i += 2;
+        continue;
+      }
+      if (strcmp(argv[i], "--replay") == 0) {
+        if (strcmp(argv[i + 1], "random") == 0) {
+          options.random = 1;
+        } else if (strcmp(argv[i + 1], "sequential") == 0) {
+          options.random = 0;
+        } else {
+          fprintf(stderr, "Unknown replay mode %s\n", argv[i + 1]);
+          exit(1);
+        }
+        i += 2;
+        continue;
+      }
+      if (strcmp(argv[i], "--calls") == 0) {
+        options.calls = strtoull(argv[i + 1], NULL, 0);
+        if (options.calls == 0) {
+          fprintf(stderr, "--calls needs a positive count\n");
+          exit(1);
+        }
+        i += 2;
+        continue;
+      }
+      if (strcmp(argv[i], "--pool_mb") == 0) {
+        options.pool_bytes = strtoull(argv[i + 1], NULL, 0) << 20;
+        i += 2;
+        continue;
+      }
+    }
     int j;
     for (j = 0; j < NUMTESTS; j++) {
       if (strcmp(argv[i], alltests[j].flag)==0) {
-        struct Result r = search_memcpy_analog(&alltests[j]);
+        struct Result r = (options.random ?
+                           random_memcpy_analog(&alltests[j], &profile,
+                                                &options) :
+                           search_memcpy_analog(&alltests[j], &profile));
         printf("%s %s=%.4f\n", r.function, r.metricname, r.metric);
       }
     }
     i++;
   }
+  free_memcpy_profile(&profile);
 }
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_ANALOG_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_ANALOG_H_
+
+#include <stdint.h>
+
+// One bucket of a mem* size profile: copy_count calls of copy_bytes with the
+// given source and destination alignment within a 64 byte cacheline.
+// This is also the on-disk record of binary profiles (see memcpy_profile.h),
+// so don't change the layout.
+struct MemcpyProfile {
+  uint64_t copy_bytes;
+  uint32_t src_mod_64;
+  uint32_t dst_mod_64;
+  uint64_t copy_count;
+};
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_ANALOG_H_
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "third_party/platform_benchmarks/analogs/memcpy_profile.h"
+
+#define MAX_LINE_LENGTH 256
+// Largest copy_bytes we accept. The replay buffers are sized from the largest
+// entry, so this keeps them (and their size arithmetic) sane.
+#define MAX_PROFILE_COPY_BYTES (1ULL << 30)
+
+// Used when no --profile is given. A synthetic distribution, heavy on small
+// sizes with a long tail, not a measured fleet profile.
+static const struct MemcpyProfile default_profile[] = {
+  {0, 0, 0, 20000},
+  {1, 3, 7, 60000},
+  {4, 0, 4, 150000},
+  {8, 0, 0, 400000},
+  {8, 8, 40, 100000},
+  {13, 5, 11, 120000},
+  {16, 0, 0, 300000},
+  {24, 8, 16, 150000},
+  {32, 0, 32, 200000},
+  {48, 16, 0, 80000},
+  {64, 0, 0, 120000},
+  {100, 4, 28, 40000},
+  {128, 0, 0, 50000},
+  {256, 0, 0, 30000},
+  {300, 12, 52, 10000},
+  {512, 0, 0, 15000},
+  {1024, 0, 0, 8000},
+  {1500, 2, 6, 4000},
+  {4096, 0, 0, 3000},
+  {8192, 0, 0, 1000},
+  {16384, 0, 0, 500},
+  {65536, 0, 0, 100},
+  {262144, 0, 0, 20},
+  {1048576, 0, 0, 4},
+};
+
+void default_memcpy_profile(struct Profile* profile) {
+  profile->entries = default_profile;
+  profile->count = sizeof(default_profile) / sizeof(default_profile[0]);
+  profile->map = NULL;
+  profile->map_bytes = 0;
+  profile->owned = NULL;
+}
+
+// Returns NULL if e is usable, else what is wrong with it.
+static const char* invalid_entry(const struct MemcpyProfile* e) {
+  if (e->src_mod_64 >= 64 || e->dst_mod_64 >= 64) {
+    return "alignment must be below 64";
+  }
+  if (e->copy_bytes > MAX_PROFILE_COPY_BYTES) {
+    return "copy_bytes must be at most 1 GB";
+  }
+  return NULL;
+}
+
+static void load_binary_profile(const char* path, const int fd,
+                                const size_t bytes, struct Profile* profile) {
+  void* map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  const struct MemcpyProfileHeader* header =
+      (const struct MemcpyProfileHeader*)map;
+  if (header->entries == 0 ||
+      header->entries > (bytes - sizeof(*header)) /
+                        sizeof(struct MemcpyProfile)) {
+    fprintf(stderr, "%s: truncated binary profile\n", path);
+    exit(1);
+  }
+  const struct MemcpyProfile* entries =
+      (const struct MemcpyProfile*)(header + 1);
+  uint64_t p;
+  for (p = 0; p < header->entries; p++) {
+    const char* invalid = invalid_entry(&entries[p]);
+    if (invalid != NULL) {
+      fprintf(stderr, "%s: entry %llu: %s\n", path, (unsigned long long)p,
+              invalid);
+      exit(1);
+    }
+  }
+  profile->entries = entries;
+  profile->count = header->entries;
+  profile->map = map;
+  profile->map_bytes = bytes;
+  profile->owned = NULL;
+}
+
+static void load_csv_profile(const char* path, struct Profile* profile) {
+  FILE* f = fopen(path, "r");
+  char line[MAX_LINE_LENGTH];
+  uint64_t capacity = 1024;
+  uint64_t n = 0;
+  int lineno = 0;
+
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  struct MemcpyProfile* entries =
+      (struct MemcpyProfile*)malloc(sizeof(struct MemcpyProfile) * capacity);
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long long copy_bytes, copy_count;
+    unsigned src_mod_64, dst_mod_64;
+    lineno++;
+
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+    if (sscanf(line, "%llu , %u , %u , %llu", &copy_bytes, &src_mod_64,
+               &dst_mod_64, &copy_count) != 4) {
+      if (n == 0 && lineno == 1) continue;  // Header.
+      fprintf(stderr, "%s:%d: expected copy_bytes,src_mod_64,dst_mod_64,"
+              "copy_count\n", path, lineno);
+      exit(1);
+    }
+    if (n == capacity) {
+      capacity *= 2;
+      entries = (struct MemcpyProfile*)realloc(
+          entries, sizeof(struct MemcpyProfile) * capacity);
+    }
+    entries[n].copy_bytes = copy_bytes;
+    entries[n].src_mod_64 = src_mod_64;
+    entries[n].dst_mod_64 = dst_mod_64;
+    entries[n].copy_count = copy_count;
+    const char* invalid = invalid_entry(&entries[n]);
+    if (invalid != NULL) {
+      fprintf(stderr, "%s:%d: %s\n", path, lineno, invalid);
+      exit(1);
+    }
+    n++;
+  }
+  fclose(f);
+
+  if (n == 0) {
+    fprintf(stderr, "%s: empty profile\n", path);
+    exit(1);
+  }
+  profile->entries = entries;
+  profile->count = n;
+  profile->map = NULL;
+  profile->map_bytes = 0;
+  profile->owned = entries;
+}
+
+void load_memcpy_profile(const char* path, struct Profile* profile) {
+  struct MemcpyProfileHeader header;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    exit(1);
+  }
+  if (st.st_size >= (off_t)sizeof(header) &&
+      read(fd, &header, sizeof(header)) == sizeof(header) &&
+      memcmp(header.magic, PROFILE_MAGIC, sizeof(header.magic)) == 0) {
+    load_binary_profile(path, fd, st.st_size, profile);
+  } else {
+    load_csv_profile(path, profile);
+  }
+  close(fd);
+}
+
+int write_memcpy_profile(const char* path, const struct Profile* profile) {
+  struct MemcpyProfileHeader header;
+  FILE* f = fopen(path, "wb");
+
+  if (f == NULL) return -1;
+  memcpy(header.magic, PROFILE_MAGIC, sizeof(header.magic));
+  header.entries = profile->count;
+  if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+      fwrite(profile->entries, sizeof(struct MemcpyProfile), profile->count,
+             f) != profile->count) {
+    fclose(f);
+    return -1;
+  }
+  return fclose(f);
+}
+
+void free_memcpy_profile(struct Profile* profile) {
+  if (profile->map != NULL) munmap(profile->map, profile->map_bytes);
+  free(profile->owned);
+  profile->entries = NULL;
+  profile->count = 0;
+  profile->map = NULL;
+  profile->owned = NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_PROFILE_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "third_party/platform_benchmarks/analogs/memcpy_analog.h"
+
+// Profiles on disk come in two forms.
+//
+// CSV, one entry per line:
+//   copy_bytes,src_mod_64,dst_mod_64,copy_count
+// Blank lines, lines starting with '#' and a non-numeric header line are
+// skipped.
+//
+// Binary, for large traces: a MemcpyProfileHeader followed by entries
+// struct MemcpyProfile records in host byte order. It is mmapped as is.
+#define PROFILE_MAGIC "MEMPROF1"
+
+struct MemcpyProfileHeader {
+  char magic[8];
+  uint64_t entries;
+};
+
+struct Profile {
+  const struct MemcpyProfile* entries;
+  uint64_t count;
+  void* map;         // Whole file mapping for binary profiles, else NULL.
+  size_t map_bytes;
+  void* owned;       // Heap copy for CSV profiles, else NULL.
+};
+
+// The built in default_profile.
+void default_memcpy_profile(struct Profile* profile);
+
+// Loads path, binary if it starts with PROFILE_MAGIC, CSV otherwise.
+// Exits with a message on malformed input.
+void load_memcpy_profile(const char* path, struct Profile* profile);
+
+// Writes profile to path in the binary format. Returns 0 on success.
+int write_memcpy_profile(const char* path, const struct Profile* profile);
+
+void free_memcpy_profile(struct Profile* profile);
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_ANALOGS_MEMCPY_PROFILE_H_
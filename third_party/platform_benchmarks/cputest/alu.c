@@ -16,6 +16,7 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
@@ -162,3 +163,34 @@ struct Result max_alu_ipc() {
   result.resulthash = a0+a1+a2+a3+a4+a5+a6+a7;
   return result;
 }
+
+double add_chain_ghz(const uint64_t loops) {
+  // volatile, so that the compiler can't see the value either.
+  volatile uint64_t opaque = 1;
+  register uint64_t one = opaque;
+  register uint64_t a = 0;
+  register uint64_t i;
+  uint64_t t = now_nsec();
+  for (i = 0; i < loops; i++) {
+    DEPENDENT_REG_ADDS(x1k, a, one)
+  }
+  return (double)loops * LOOP1K / (now_nsec() - t);
+}
+
+// Take the best of a few runs so that frequency ramp-up doesn't drag the
+// estimate down.
+double estimate_ghz() {
+  double ghz = 0;
+  int k;
+  for (k = 0; k < 3; k++) {
+    const double run = add_chain_ghz(LOOP1M / 4);
+    if (run > ghz) {
+      ghz = run;
+    }
+  }
+  if (ghz < MIN_PLAUSIBLE_GHZ || ghz > MAX_PLAUSIBLE_GHZ) {
+    fprintf(stderr, "Estimated core clock of %.3f GHz is implausible, "
+            "per cycle metrics will be off (use --mhz)\n", ghz);
+  }
+  return ghz;
+}
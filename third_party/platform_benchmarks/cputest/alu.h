@@ -25,6 +25,14 @@
                                    :"+r"(r)             \
                                    ::"cc");
 
+// Adds a register whose value the core can't know ahead of time. Some cores
+// fold chains of immediate adds (DEPENDENT_ADDS) at rename and run them
+// faster than one add per cycle, so this is what calibrates the clock.
+#define DEPENDENT_REG_ADDS(x, r, one) asm volatile(x("add %1, %0\n\t") \
+                                                   :"+r"(r)             \
+                                                   :"r"(one)            \
+                                                   :"cc");
+
 #define DEPENDENT_ADD_SETS(x, r, r0, r1, r2, r3, r4, r5, r6, r7) \
   asm(x("add %8, %0\n\t"                                         \
         "add %8, %1\n\t"                                         \
@@ -79,6 +87,11 @@
                                    :"+r"(r)                 \
                                    ::"cc");
 
+#define DEPENDENT_REG_ADDS(x, r, one) asm volatile(x("add %0, %0, %1\n\t") \
+                                                   :"+r"(r)                 \
+                                                   :"r"(one)                \
+                                                   :"cc");
+
 #define DEPENDENT_ADD_SETS(x, r, r0, r1, r2, r3, r4, r5, r6, r7) \
   asm(x("add %0, %0, %8\n\t"                                     \
         "add %1, %1, %8\n\t"                                     \
@@ -133,6 +146,11 @@
                                    :"+r"(r)                \
                                    ::"cc");
 
+#define DEPENDENT_REG_ADDS(x, r, one) asm volatile(x("add %0, %0, %1\n\t") \
+                                                   :"+r"(r)                 \
+                                                   :"r"(one)                \
+                                                   :"cc");
+
 #define DEPENDENT_ADD_SETS(x, r, r0, r1, r2, r3, r4, r5, r6, r7) \
   asm(x("add %0, %0, %8\n\t"                                     \
         "add %1, %1, %8\n\t"                                     \
@@ -183,4 +201,16 @@
 
 #endif
 
+// Core clocks outside this range mean the estimate is wrong, eg: the add
+// chain doesn't run at one add per cycle on this core.
+#define MIN_PLAUSIBLE_GHZ 0.2
+#define MAX_PLAUSIBLE_GHZ 6.5
+
+// Core clock from loops x 1024 dependent register adds, one per cycle.
+double add_chain_ghz(const uint64_t loops);
+
+// Core clock estimated from add_chain_ghz. Warns on stderr if it is not
+// plausible.
+double estimate_ghz();
+
 #endif  // PLATFORMS_BENCHMARKS_ALU_H_
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_ATOMICS
+#define HWCAP_ATOMICS (1 << 8)
+#endif
+#endif
+
+#include "coherence.h"
+#include "multicore.h"
+#include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
+
+// Round trips per pair. The matrix does fewer so that a large machine
+// (N^2/2 pairs) finishes in minutes.
+#define PAIR_ROUND_TRIPS LOOP1M
+#define MATRIX_ROUND_TRIPS (1 << 16)
+
+#define ATOMIC_OPS_PER_THREAD LOOP1M
+
+struct PingPong {
+  volatile uint64_t* flag;
+  uint64_t round_trips;
+  uint64_t next_id;
+};
+
+// Two threads take turns bumping flag: thread 0 waits for an even value and
+// makes it odd, thread 1 waits for odd and makes it even. Every bump moves
+// the line from one core to the other.
+static struct Result ping_pong(void* arg) {
+  struct PingPong* pp = (struct PingPong*)arg;
+  const uint64_t id = __atomic_fetch_add(&pp->next_id, 1, __ATOMIC_RELAXED);
+  struct Result result;
+  uint64_t i;
+
+  uint64_t t = now_nsec();
+  for (i = 0; i < pp->round_trips; i++) {
+    while (__atomic_load_n(pp->flag, __ATOMIC_ACQUIRE) != 2 * i + id) {
+    }
+    __atomic_store_n(pp->flag, 2 * i + id + 1, __ATOMIC_RELEASE);
+  }
+  result.metric = (double)(now_nsec() - t) / (2 * pp->round_trips);
+  result.resulthash = id;
+  return result;
+}
+
+// One way cacheline transfer latency between cpu_a and cpu_b in ns.
+static double transfer_ns(const int cpu_a,
+                          const int cpu_b,
+                          const uint64_t round_trips) {
+  struct CpuList pair;
+  struct Result results[2];
+  struct PingPong pp;
+  uint64_t* line;
+
+  if (posix_memalign((void **)&line, MAX_CACHELINE_SIZE,
+                     MAX_CACHELINE_SIZE) != 0) {
+    perror("Unable to align to cacheline size\n");
+    abort();
+  }
+  *line = 0;
+
+  pair.count = 2;
+  pair.cpus[0] = cpu_a;
+  pair.cpus[1] = cpu_b;
+  pp.flag = line;
+  pp.round_trips = round_trips;
+  pp.next_id = 0;
+  run_on_cpus(&pair, ping_pong, &pp, results);
+
+  free(line);
+  return (results[0].metric + results[1].metric) / 2;
+}
+
+struct Result c2c_latency(const int cpu_a, const int cpu_b) {
+  struct Result result;
+  result.resulthash = 0;
+  result.metric = 0;
+  strcpy(result.metricname, "ns_per_transfer");
+
+  if (cpu_a == cpu_b) {
+    sprintf(result.function, "%s needs two different cpus", __FUNCTION__);
+    return result;
+  }
+  result.metric = transfer_ns(cpu_a, cpu_b, PAIR_ROUND_TRIPS);
+  sprintf(result.function, "%s(%d, %d)", __FUNCTION__, cpu_a, cpu_b);
+  return result;
+}
+
+struct Result c2c_latency_matrix(const int maxcpus) {
+  struct Result result;
+  struct CpuList* cpus = (struct CpuList*)malloc(sizeof(struct CpuList));
+  result.resulthash = 0;
+  result.metric = 0;
+  strcpy(result.metricname, "ns_per_transfer");
+
+  // All allowed (or given) cpus if maxcpus is 0 or more than we have.
+  test_cpus(MAX_CPUS, cpus);
+  if (maxcpus > 0 && maxcpus < cpus->count) {
+    cpus->count = maxcpus;
+  }
+  if (cpus->count < 2) {
+    sprintf(result.function, "%s needs at least two cpus", __FUNCTION__);
+    free(cpus);
+    return result;
+  }
+
+  const int n = cpus->count;
+  int a, b;
+  double sum = 0;
+  for (a = 0; a < n; a++) {
+    for (b = a + 1; b < n; b++) {
+      result.metric = transfer_ns(cpus->cpus[a], cpus->cpus[b],
+                                  MATRIX_ROUND_TRIPS);
+      sprintf(result.function, "%s(%d, %d)", __FUNCTION__, cpus->cpus[a],
+              cpus->cpus[b]);
+      emit_point(&result);
+      sum += result.metric;
+    }
+  }
+
+  result.metric = sum / (n * (n - 1) / 2);
+  sprintf(result.function, "%s(cpus=%d, mean)", __FUNCTION__, n);
+  free(cpus);
+  return result;
+}
+
+struct Contention {
+  int op;
+  int layout;
+  char* base;
+  uint64_t next_id;
+};
+
+static struct Result hammer(void* arg) {
+  struct Contention* c = (struct Contention*)arg;
+  const uint64_t id = __atomic_fetch_add(&c->next_id, 1, __ATOMIC_RELAXED);
+  struct Result result;
+  uint64_t* target;
+  register uint64_t v = 1;
+  uint64_t i;
+
+  switch (c->layout) {
+    case LAYOUT_SHARED:
+      target = (uint64_t*)c->base;
+      break;
+    case LAYOUT_FALSE_SHARING:
+      target = (uint64_t*)c->base + id;
+      break;
+    default:
+      target = (uint64_t*)(c->base + id * MAX_CACHELINE_SIZE);
+      break;
+  }
+
+  uint64_t t = now_nsec();
+  switch (c->op) {
+    case ATOMIC_OP_FETCH_ADD:
+      for (i = 0; i < ATOMIC_OPS_PER_THREAD; i++) {
+        v = 1;
+        ATOMIC_FETCH_ADD(target, v)
+      }
+      break;
+
+    case ATOMIC_OP_CAS: {
+      uint64_t seen = *target;
+      for (i = 0; i < ATOMIC_OPS_PER_THREAD; i++) {
+        do {
+          v = seen;
+          ATOMIC_CAS(target, seen, v + 1)
+        } while (seen != v);
+        seen = v + 1;
+      }
+      break;
+    }
+
+#ifdef ATOMIC_LL_SC_ADD
+    case ATOMIC_OP_LL_SC:
+      for (i = 0; i < ATOMIC_OPS_PER_THREAD; i++) {
+        ATOMIC_LL_SC_ADD(target, v)
+      }
+      break;
+#endif
+
+    default:
+      assert(0);
+  }
+  result.metric = (double)(now_nsec() - t) / ATOMIC_OPS_PER_THREAD;
+  result.resulthash = v;
+  return result;
+}
+
+static const char* atomic_op_name(const int op) {
+  switch (op) {
+    case ATOMIC_OP_FETCH_ADD:
+      return FETCH_ADD_NAME;
+    case ATOMIC_OP_CAS:
+      return CAS_NAME;
+    case ATOMIC_OP_LL_SC:
+      return LL_SC_NAME;
+    default:
+      return NULL;
+  }
+}
+
+static const char* layout_name(const int layout) {
+  switch (layout) {
+    case LAYOUT_SHARED:
+      return "shared line";
+    case LAYOUT_FALSE_SHARING:
+      return "false sharing";
+    case LAYOUT_PADDED:
+      return "padded";
+    default:
+      return NULL;
+  }
+}
+
+struct Result atomic_contention(const int op,
+                                const int layout,
+                                const int maxthreads) {
+  struct Result result;
+  result.resulthash = 0;
+  result.metric = 0;
+  strcpy(result.metricname, "ns_per_op");
+
+  const char* opname = atomic_op_name(op);
+  assert(layout_name(layout) != NULL);
+#if defined(__aarch64__)
+  if (op != ATOMIC_OP_LL_SC && !(getauxval(AT_HWCAP) & HWCAP_ATOMICS)) {
+    opname = NULL;  // No LSE atomics.
+  }
+#endif
+  if (opname == NULL) {
+    sprintf(result.function, "%s(op=%d) NOT APPLICABLE on Current Platform",
+            __FUNCTION__, op);
+    return result;
+  }
+
+  struct CpuList* cpus = (struct CpuList*)malloc(sizeof(struct CpuList));
+  test_cpus(MAX_CPUS, cpus);
+  int n = maxthreads > 0 && maxthreads < cpus->count ?
+      maxthreads : cpus->count;
+  // More threads than slots would share 8 bytes, which is true sharing.
+  if (layout == LAYOUT_FALSE_SHARING && n > (int)FALSE_SHARING_SLOTS) {
+    n = FALSE_SHARING_SLOTS;
+  }
+
+  struct Contention c;
+  struct Result* results = (struct Result*)malloc(sizeof(struct Result) * n);
+  if (posix_memalign((void **)&c.base, MAX_CACHELINE_SIZE,
+                     MAX_CACHELINE_SIZE * n) != 0) {
+    perror("Unable to align to cacheline size\n");
+    abort();
+  }
+  memset(c.base, 0, MAX_CACHELINE_SIZE * n);
+  c.op = op;
+  c.layout = layout;
+
+  // 1, 2, 4 ... threads, and n itself.
+  int threads = 1;
+  while (1) {
+    int k;
+    double ns_per_op = 0;
+
+    cpus->count = threads;
+    c.next_id = 0;
+    run_on_cpus(cpus, hammer, &c, results);
+    for (k = 0; k < threads; k++) {
+      ns_per_op += results[k].metric / threads;
+    }
+    result.metric = ns_per_op;
+    result.resulthash = results[0].resulthash;
+    sprintf(result.function, "%s(%s, %s, threads=%d)", __FUNCTION__,
+            opname, layout_name(layout), threads);
+    emit_point(&result);
+    if (threads == n) break;
+    threads = threads * 2 < n ? threads * 2 : n;
+  }
+
+  sprintf(result.function, "%s(%s, %s, threads=1-%d)", __FUNCTION__,
+          opname, layout_name(layout), n);
+  free(c.base);
+  free(results);
+  free(cpus);
+  return result;
+}
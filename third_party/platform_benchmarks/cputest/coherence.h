@@ -0,0 +1,107 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_COHERENCE_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_COHERENCE_H_
+
+#include <stdint.h>
+
+#include "third_party/platform_benchmarks/util.h"
+
+// Atomic operations hammered by atomic_contention.
+#define ATOMIC_OP_FETCH_ADD 0
+#define ATOMIC_OP_CAS 1       // CAS loop incrementing the target.
+#define ATOMIC_OP_LL_SC 2     // Load-linked/store-conditional increment.
+
+// Where each thread's target lives.
+#define LAYOUT_SHARED 0         // All threads on the same 8 bytes.
+#define LAYOUT_FALSE_SHARING 1  // Own 8 bytes, same 64 byte line (<=8 threads).
+#define LAYOUT_PADDED 2         // Own cacheline. No sharing (baseline).
+
+// Threads that fit in one 64 byte line with LAYOUT_FALSE_SHARING.
+#define FALSE_SHARING_SLOTS (64 / sizeof(uint64_t))
+
+// ATOMIC_FETCH_ADD(p, v) adds v to *p. ATOMIC_LL_SC_ADD(p, v) adds 1 to *p
+// with an explicit LL/SC loop, where the ISA has one.
+// After ATOMIC_CAS(p, expected, desired), expected holds the value *p had
+// before the operation. The CAS succeeded iff that equals what was passed in.
+
+#if defined(__x86_64__)
+
+#define FETCH_ADD_NAME "lock xadd"
+#define CAS_NAME "lock cmpxchg"
+#define LL_SC_NAME NULL  // Not an x86 concept.
+
+#define ATOMIC_FETCH_ADD(p, v) asm volatile("lock xaddq %0, %1\n\t" \
+                                            : "+r"(v), "+m"(*(p))   \
+                                            :: "memory", "cc");
+
+#define ATOMIC_CAS(p, expected, desired)                 \
+  asm volatile("lock cmpxchgq %2, %1\n\t"                \
+               : "+a"(expected), "+m"(*(p))              \
+               : "r"(desired)                            \
+               : "memory", "cc");
+
+#elif defined(__ppc64__)
+
+#define FETCH_ADD_NAME "fetch_add"
+#define CAS_NAME "cas"
+#define LL_SC_NAME "ldarx/stdcx."
+
+#define ATOMIC_FETCH_ADD(p, v) v = __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+
+#define ATOMIC_CAS(p, expected, desired)                          \
+  __atomic_compare_exchange_n(p, &(expected), desired, 0,         \
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+#define ATOMIC_LL_SC_ADD(p, v) v = __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+
+#elif defined(__aarch64__)
+
+// LSE atomics. Only used when HWCAP_ATOMICS says the CPU has them.
+#define FETCH_ADD_NAME "ldaddal"
+#define CAS_NAME "casal"
+#define LL_SC_NAME "ldaxr/stlxr"
+
+#define ATOMIC_FETCH_ADD(p, v) asm volatile(".arch_extension lse\n\t"   \
+                                            "ldaddal %0, %0, [%1]\n\t" \
+                                            : "+r"(v)                  \
+                                            : "r"(p)                   \
+                                            : "memory");
+
+#define ATOMIC_CAS(p, expected, desired)                 \
+  asm volatile(".arch_extension lse\n\t"                 \
+               "casal %0, %2, [%1]\n\t"                  \
+               : "+r"(expected)                          \
+               : "r"(p), "r"(desired)                    \
+               : "memory");
+
+#define ATOMIC_LL_SC_ADD(p, v)                           \
+  {                                                      \
+    uint64_t status;                                     \
+    asm volatile("1:\n\t"                                \
+                 "ldaxr %0, [%2]\n\t"                    \
+                 "add %0, %0, %3\n\t"                    \
+                 "stlxr %w1, %0, [%2]\n\t"               \
+                 "cbnz %w1, 1b\n\t"                      \
+                 : "=&r"(v), "=&r"(status)               \
+                 : "r"(p), "r"((uint64_t)1)              \
+                 : "memory");                            \
+  }
+
+#endif
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_COHERENCE_H_
@@ -14,36 +14,707 @@
  * limitations under the License.
  */
 
+#include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alu.h"
 #include "cputest.h"
+#include "latency.h"
+#include "multicore.h"
+#include "sweep.h"
+#include "third_party/platform_benchmarks/perf_counters.h"
 #include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
 
 static void helpinfo() {
   int i;
   for (i = 0; i < NUMTESTS; i++) {
     printf("%40s\t%s\n", alltests[i].name, alltests[i].helpinfo);
   }
+  printf("\nOptions (apply to every test that follows them)\n");
+  printf("%40s\t%s\n", "--threads N",
+         "Run each test concurrently on the first N allowed cpus");
+  printf("%40s\t%s\n", "--cpus list",
+         "Run each test concurrently on cpus in list (eg: 0-3,8)");
+  printf("%40s\t%s\n", "--smt_pair C",
+         "Run each test concurrently on cpu C and its SMT sibling");
+  printf("%40s\t%s\n", "--warmup W",
+         "Run each test W times untimed before measuring (default 0)");
+  printf("%40s\t%s\n", "--repetitions K",
+         "Run each test K times, report median, min, p90, max and stddev");
+  printf("%40s\t%s\n", "--calibrate",
+         "Estimate GHz with dependent adds, report metric per cycle");
+  printf("%40s\t%s\n", "--mhz M",
+         "Use known core frequency M (MHz) to report metric per cycle");
+  printf("%40s\t%s\n", "--counters",
+         "Attach hardware performance counters (perf_event_open) to results, "
+         "counting the timed loop where the test marks it, else the whole "
+         "test call");
+  printf("%40s\t%s\n", "--format F",
+         "F=text (default), csv or json (one object per line)");
+  printf("%40s\t%s\n", "--sweep A lo hi S",
+         "Run the next test with its argument A (1 based) from lo to hi and "
+         "report the knees. S: points per octave, refined around knees "
+         "(0: every value, for log2 arguments)");
+  printf("%40s\t%s\n", "--platform_profile logb",
+         "Sweep cache footprints up to (1<<logb) bytes, BTB size, branch "
+         "history and rep movsb vs AVX copy sizes, print the knees");
 }
 
+// Test arguments are passed as unsigned ints. A negative argument (eg: node
+// -1 for "no numa binding") is parsed as a signed value and passed as the bit
+// pattern of the int the test declares.
 static unsigned int convert_or_crash(const char *input) {
   char *endptr;
-  unsigned int result = strtoul(input, &endptr, 0);
+  long long value;
+  int out_of_range;
 
-  if (endptr[0] != '\0') {
+  errno = 0;
+  if (input[0] == '-') {
+    value = strtoll(input, &endptr, 0);
+    out_of_range = value < INT_MIN;
+  } else {
+    unsigned long long uvalue = strtoull(input, &endptr, 0);
+    out_of_range = uvalue > UINT_MAX;
+    value = out_of_range ? 0 : (long long)uvalue;
+  }
+
+  if (endptr == input || endptr[0] != '\0') {
     fprintf(stderr, "%s is not a number\n", input);
     exit(1);
   }
 
-  if (errno == ERANGE) {
+  if (errno == ERANGE || out_of_range) {
     fprintf(stderr, "%s is out of range\n", input);
     exit(1);
   }
-  return result;
+  return value < 0 ? (unsigned int)(int)value : (unsigned int)value;
+}
+
+#define MAX_TEST_ARGS 5
+
+enum OutputFormat {
+  FORMAT_TEXT,
+  FORMAT_CSV,
+  FORMAT_JSON,
+};
+
+struct Options {
+  int warmup;
+  int repetitions;
+  double ghz;  // 0 if core frequency is unknown.
+  int counters;
+  enum OutputFormat format;
+  // --sweep of the next test. sweep_arg is 1 based, 0 for no sweep.
+  int sweep_arg;
+  unsigned int sweep_lo;
+  unsigned int sweep_hi;
+  int sweep_steps;
+};
+
+struct Invocation {
+  const struct Test* test;
+  unsigned int params[MAX_TEST_ARGS];
+  const struct Options* options;
+};
+
+static struct Result invoke(const struct Invocation* inv) {
+  const unsigned int* p = inv->params;
+  struct Result r;
+  switch (inv->test->args) {
+    case 0:
+      r = inv->test->function();
+      break;
+    case 1:
+      r = inv->test->function(p[0]);
+      break;
+    case 2:
+      r = inv->test->function(p[0], p[1]);
+      break;
+    case 3:
+      r = inv->test->function(p[0], p[1], p[2]);
+      break;
+    case 4:
+      r = inv->test->function(p[0], p[1], p[2], p[3]);
+      break;
+    case 5:
+      r = inv->test->function(p[0], p[1], p[2], p[3], p[4]);
+      break;
+    default:
+      perror("Unsupported number of arguments\n");
+      exit(1);
+  };
+  return r;
+}
+
+// Counters for one call of a test. Tests that mark their timed loop with
+// timed_region_begin/end() get just that counted, others the whole call.
+struct RegionCounters {
+  struct PerfCounters pc;
+  int marked;
+};
+
+static void counters_region_begin(void* arg) {
+  struct RegionCounters* rc = (struct RegionCounters*)arg;
+  if (rc->marked) {
+    perf_counters_resume(&rc->pc);
+  } else {
+    // Throws away what the setup counted so far.
+    perf_counters_start(&rc->pc);
+    rc->marked = 1;
+  }
+}
+
+static void counters_region_end(void* arg) {
+  perf_counters_pause(&((struct RegionCounters*)arg)->pc);
+}
+
+// Runs the warmup iterations untimed, then the timed repetitions.
+// The reported metric is the median of the repetitions.
+static struct Result invoke_repeated(void* arg) {
+  const struct Invocation* inv = (const struct Invocation*)arg;
+  const int repetitions = inv->options->repetitions;
+  double* samples = (double*)malloc(sizeof(double) * repetitions);
+  struct Result r;
+  struct RegionCounters rc;
+  int k;
+
+  const int counting =
+      inv->options->counters && perf_counters_open(&rc.pc) > 0;
+
+  for (k = 0; k < inv->options->warmup; k++) {
+    invoke(inv);
+  }
+  if (counting) {
+    set_timed_region_hooks(counters_region_begin, counters_region_end, &rc);
+  }
+  for (k = 0; k < repetitions; k++) {
+    // Under run_multicore, line every thread up again before each repetition.
+    sync_cpus();
+    if (counting) {
+      rc.marked = 0;
+      perf_counters_start(&rc.pc);
+    }
+    r = invoke(inv);
+    if (counting) perf_counters_stop(&rc.pc);
+    samples[k] = r.metric;
+  }
+  summarize_samples(samples, repetitions, &r);
+  if (counting) {
+    set_timed_region_hooks(NULL, NULL, NULL);
+    perf_counters_close(&rc.pc, &r.counters);
+  } else {
+    r.counters.available = 0;
+  }
+  r.metric = r.median;
+  free(samples);
+  return r;
+}
+
+static void print_counter(const char* name,
+                          const double value,
+                          const enum OutputFormat format) {
+  switch (format) {
+    case FORMAT_TEXT:
+      if (value >= 0) printf("\t%s=%.4f", name, value);
+      break;
+    case FORMAT_CSV:
+      if (value >= 0) {
+        printf(",%.4f", value);
+      } else {
+        printf(",");
+      }
+      break;
+    case FORMAT_JSON:
+      if (value >= 0) printf(", \"%s\": %.4f", name, value);
+      break;
+  }
+}
+
+static void print_counters(const struct Counters* c,
+                           const enum OutputFormat format) {
+  print_counter("IPC", c->ipc, format);
+  print_counter("branch_MPKI", c->branch_mpki, format);
+  print_counter("branch_miss_rate", c->branch_miss_rate, format);
+  print_counter("L1D_MPKI", c->l1d_mpki, format);
+  print_counter("LLC_MPKI", c->llc_mpki, format);
+  print_counter("dTLB_MPKI", c->dtlb_mpki, format);
+  print_counter("iTLB_MPKI", c->itlb_mpki, format);
+}
+
+static void print_escaped(const char* str, const enum OutputFormat format) {
+  const char* c;
+  putchar('"');
+  for (c = str; *c != '\0'; c++) {
+    if (*c == '"') {
+      printf(format == FORMAT_JSON ? "\\\"" : "\"\"");
+    } else if (format == FORMAT_JSON && *c == '\\') {
+      printf("\\\\");
+    } else if (format == FORMAT_JSON && (unsigned char)*c < 0x20) {
+      printf("\\u%04x", *c);
+    } else {
+      putchar(*c);
+    }
+  }
+  putchar('"');
+}
+
+// Latency tests report ns_per_<unit>, where lower is better. Everything else
+// is a rate.
+static int is_latency(const struct Result* r) {
+  return strncmp(r->metricname, "ns_per_", strlen("ns_per_")) == 0;
+}
+
+// cpu is "" for tests that are not pinned, otherwise the cpu number, or
+// "all" / "worst" for the multicore summary.
+static void print_result(const struct Result* r,
+                         const char* cpu,
+                         const struct Options* options) {
+  const double ghz = options->ghz;
+  const double units_per_ns = (!is_latency(r) ? r->metric :
+                              r->metric > 0 ? 1 / r->metric : 0);
+  const double per_cycle = ghz > 0 ? units_per_ns / ghz : 0;
+  const double cycles_per_unit = units_per_ns > 0 ? ghz / units_per_ns : 0;
+
+  switch (options->format) {
+    case FORMAT_TEXT:
+      printf("%s", r->function);
+      if (cpu[0] != '\0') {
+        printf("\tcpu=%s", cpu);
+      }
+      printf("\tresulthash=%" PRIx64 "\t%s=%.6f",
+             r->resulthash, r->metricname, r->metric);
+      if (r->repetitions > 1) {
+        printf("\tmin=%.6f\tmedian=%.6f\tp90=%.6f\tmax=%.6f\tstddev=%.6f"
+               "\trepetitions=%d",
+               r->min, r->median, r->p90, r->max, r->stddev, r->repetitions);
+      }
+      if (ghz > 0) {
+        printf("\tGHz=%.3f\tper_cycle=%.6f\tcycles_per_unit=%.6f",
+               ghz, per_cycle, cycles_per_unit);
+      }
+      if (options->counters) {
+        if (r->counters.available) {
+          print_counters(&r->counters, FORMAT_TEXT);
+        } else {
+          printf("\tcounters=unavailable");
+        }
+      }
+      printf("\n");
+      break;
+
+    case FORMAT_CSV: {
+      static int header_printed = 0;
+      if (!header_printed) {
+        printf("function,cpu,resulthash,metricname,metric,repetitions,"
+               "min,median,p90,max,stddev,ghz,per_cycle,cycles_per_unit,"
+               "ipc,branch_mpki,branch_miss_rate,l1d_mpki,llc_mpki,"
+               "dtlb_mpki,itlb_mpki\n");
+        header_printed = 1;
+      }
+      print_escaped(r->function, FORMAT_CSV);
+      printf(",%s,%" PRIx64 ",", cpu, r->resulthash);
+      print_escaped(r->metricname, FORMAT_CSV);
+      printf(",%.6f,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.6f,%.6f",
+             r->metric, r->repetitions, r->min, r->median, r->p90, r->max,
+             r->stddev, ghz, per_cycle, cycles_per_unit);
+      if (r->counters.available) {
+        print_counters(&r->counters, FORMAT_CSV);
+      } else {
+        printf(",,,,,,,");
+      }
+      printf("\n");
+      break;
+    }
+
+    case FORMAT_JSON:
+      printf("{\"function\": ");
+      print_escaped(r->function, FORMAT_JSON);
+      printf(", \"cpu\": \"%s\", \"resulthash\": \"%" PRIx64 "\", "
+             "\"metricname\": ", cpu, r->resulthash);
+      print_escaped(r->metricname, FORMAT_JSON);
+      printf(", \"metric\": %.6f, \"repetitions\": %d, \"min\": %.6f, "
+             "\"median\": %.6f, \"p90\": %.6f, \"max\": %.6f, "
+             "\"stddev\": %.6f",
+             r->metric, r->repetitions, r->min, r->median, r->p90, r->max,
+             r->stddev);
+      if (ghz > 0) {
+        printf(", \"ghz\": %.3f, \"per_cycle\": %.6f, "
+               "\"cycles_per_unit\": %.6f",
+               ghz, per_cycle, cycles_per_unit);
+      }
+      if (options->counters) {
+        if (r->counters.available) {
+          printf(", \"counters\": {\"available\": true");
+          print_counters(&r->counters, FORMAT_JSON);
+          printf("}");
+        } else {
+          printf(", \"counters\": {\"available\": false}");
+        }
+      }
+      printf("}\n");
+      break;
+  }
+}
+
+// Runs the test once per cpu in cpus and prints per cpu results, the sum of
+// all metrics (mean for latencies), and the cpu with the worst metric.
+static void run_multicore(struct Invocation* inv, const struct CpuList* cpus) {
+  struct Result* results =
+      (struct Result*)malloc(sizeof(struct Result) * cpus->count);
+  run_on_cpus(cpus, invoke_repeated, inv, results);
+
+  int k;
+  int worst = 0;
+  char cpu[16];
+  struct Result aggregate = results[0];
+  aggregate.metric = 0;
+  aggregate.min = aggregate.median = aggregate.p90 = aggregate.max = 0;
+  aggregate.stddev = 0;
+  // Counters are per thread; see the per cpu results.
+  aggregate.counters.available = 0;
+  for (k = 0; k < cpus->count; k++) {
+    snprintf(cpu, sizeof(cpu), "%d", cpus->cpus[k]);
+    print_result(&results[k], cpu, inv->options);
+    aggregate.metric += results[k].metric;
+    aggregate.min += results[k].min;
+    aggregate.median += results[k].median;
+    aggregate.p90 += results[k].p90;
+    aggregate.max += results[k].max;
+    aggregate.stddev += results[k].stddev * results[k].stddev;
+    if (is_latency(&results[k]) ?
+        results[k].metric > results[worst].metric :
+        results[k].metric < results[worst].metric) {
+      worst = k;
+    }
+  }
+  aggregate.stddev = sqrt(aggregate.stddev);
+  if (is_latency(&aggregate)) {
+    aggregate.metric /= cpus->count;
+    aggregate.min /= cpus->count;
+    aggregate.median /= cpus->count;
+    aggregate.p90 /= cpus->count;
+    aggregate.max /= cpus->count;
+    aggregate.stddev /= cpus->count;
+  }
+
+  if (inv->options->format == FORMAT_TEXT) {
+    printf("%s\tcpus=%d\t%s_%s=%.6f\tworst_cpu=%d\tworst_%s=%.6f\n",
+           results[0].function, cpus->count,
+           is_latency(&aggregate) ? "mean" : "aggregate",
+           results[0].metricname, aggregate.metric,
+           cpus->cpus[worst], results[0].metricname, results[worst].metric);
+  } else {
+    print_result(&aggregate, "all", inv->options);
+    snprintf(cpu, sizeof(cpu), "worst:%d", cpus->cpus[worst]);
+    print_result(&results[worst], cpu, inv->options);
+  }
+  free(results);
+}
+
+// Prints a point of a curve or matrix test like a one shot result.
+static void print_point(const struct Result* point, void* options) {
+  struct Result r = *point;
+  r.repetitions = 1;
+  r.min = r.median = r.p90 = r.max = r.metric;
+  r.stddev = 0;
+  r.counters.available = 0;
+  print_result(&r, "", (const struct Options*)options);
+}
+
+// Tests that run threads of their own. Rather than running them once on
+// each cpu of --threads/--cpus/--smt_pair, they get that list to pin to
+// (c2c_latency names its two cpus itself).
+static int pins_own_threads(const struct Test* test) {
+  return (test->function == (struct Result (*)())mem_bandwidth ||
+          test->function == (struct Result (*)())loaded_latency ||
+          test->function == (struct Result (*)())c2c_latency ||
+          test->function == (struct Result (*)())c2c_latency_matrix ||
+          test->function == (struct Result (*)())atomic_contention);
+}
+
+static const struct Test* find_test(const char* flag) {
+  int j;
+  for (j = 0; j < NUMTESTS; j++) {
+    const size_t flaglen = (strchr(alltests[j].name, ' ') ?
+                            (size_t)(strchr(alltests[j].name, ' ') -
+                                     alltests[j].name) :
+                            strlen(alltests[j].name));
+    if (strlen(flag) == flaglen &&
+        strncmp(flag, alltests[j].name, flaglen) == 0) {
+      return &alltests[j];
+    }
+  }
+  return NULL;
+}
+
+// A test run by a sweep, with argument arg (0 based) set to each x, or to
+// log2(x) if log_arg is set.
+struct SweepInvocation {
+  struct Invocation inv;
+  int arg;
+  int log_arg;
+  struct Sweep* sweep;
+};
+
+static double measure_invocation(void* arg, const uint64_t x) {
+  struct SweepInvocation* si = (struct SweepInvocation*)arg;
+  si->inv.params[si->arg] =
+      si->log_arg ? (uint64_t)(63 - __builtin_clzll(x)) : x;
+  struct Result r = invoke_repeated(&si->inv);
+  print_result(&r, "", si->inv.options);
+  fflush(stdout);
+  si->sweep->lower_is_better = is_latency(&r);
+  return r.metric;
+}
+
+static void sweep_invocation(struct Sweep* sweep,
+                             struct SweepInvocation* si,
+                             const char* flag,
+                             const unsigned int* params,
+                             const int arg,
+                             const struct Options* options) {
+  si->inv.test = find_test(flag);
+  assert(si->inv.test != NULL && arg < si->inv.test->args);
+  memcpy(si->inv.params, params, sizeof(si->inv.params));
+  si->inv.options = options;
+  si->arg = arg;
+  si->sweep = sweep;
+  sweep->measure = measure_invocation;
+  sweep->arg = si;
+  // Sweeps run on this thread only, so the test can keep its buffers from
+  // one point to the next.
+  set_buffer_reuse(1);
+  run_sweep(sweep);
+  set_buffer_reuse(0);
+}
+
+static void print_knees(const char* flag,
+                        const int arg,
+                        const struct Sweep* s,
+                        const struct Options* options) {
+  int k;
+  if (options->format == FORMAT_JSON) {
+    printf("{\"sweep\": \"%s\", \"arg\": %d, \"lo\": %" PRIu64
+           ", \"hi\": %" PRIu64 ", \"points\": %d, \"knees\": [",
+           flag, arg, s->lo, s->hi, s->count);
+    for (k = 0; k < s->knee_count; k++) {
+      printf("%s%" PRIu64, k > 0 ? ", " : "", s->knees[k]);
+    }
+    printf("]}\n");
+    return;
+  }
+  // Comment lines keep a csv table intact.
+  printf("%ssweep(%s, arg %d, %" PRIu64 "-%" PRIu64 ")\tpoints=%d\tknees=",
+         options->format == FORMAT_CSV ? "# " : "", flag, arg, s->lo, s->hi,
+         s->count);
+  for (k = 0; k < s->knee_count; k++) {
+    printf("%s%" PRIu64, k > 0 ? "," : "", s->knees[k]);
+  }
+  printf("%s\n", s->knee_count > 0 ? "" : "none");
+}
+
+struct FootprintSweep {
+  char* m;  // Big enough for the largest footprint of the sweep.
+  const struct Options* options;
+};
+
+// The last footprint at which a page_local chase is still as fast as the
+// footprint before it is the size of a cache level.
+static double measure_footprint(void* arg, const uint64_t bytes) {
+  const struct FootprintSweep* fs = (const struct FootprintSweep*)arg;
+  struct Result r;
+  char str[MAX_BYTE_STRING_LENGTH];
+  uint64_t hash;
+
+  size2string(str, bytes);
+  r.metric = footprint_ns_per_load(fs->m, bytes, CHASE_PAGE_LOCAL, &hash);
+  r.resulthash = hash;
+  r.repetitions = 1;
+  r.min = r.median = r.p90 = r.max = r.metric;
+  r.stddev = 0;
+  r.counters.available = 0;
+  strcpy(r.metricname, "ns_per_load");
+  snprintf(r.function, FN_NAME_LENGTH, "load_latency(%.*s, page_local, THP)",
+           BYTE_STRING_CHARS, str);
+  print_result(&r, "", fs->options);
+  fflush(stdout);
+  return r.metric;
+}
+
+#define MAX_PROFILE_ENTRIES 32
+
+struct ProfileEntry {
+  char key[32];
+  uint64_t value;
+  const char* unit;  // "bytes" or "" for counts.
+};
+
+static void add_profile_entry(struct ProfileEntry* entries,
+                              int* count,
+                              const char* key,
+                              const uint64_t value,
+                              const char* unit) {
+  if (*count == MAX_PROFILE_ENTRIES) return;
+  snprintf(entries[*count].key, sizeof(entries[*count].key), "%s", key);
+  entries[*count].value = value;
+  entries[*count].unit = unit;
+  (*count)++;
+}
+
+// 49152 -> "48K", 2097152 -> "2M", 100 -> "100".
+static void compact_count(char* str, const size_t len, const uint64_t n) {
+  static const char* suffixes = "KMGT";
+  int s = -1;
+  uint64_t v = n;
+  while (v >= 1024 && v % 1024 == 0 && s < 3) {
+    v /= 1024;
+    s++;
+  }
+  if (s < 0 && n >= 1024) {
+    // Not a whole number of K, eg: 40K + 512.
+    snprintf(str, len, "%.4gK", n / 1024.0);
+  } else if (s < 0) {
+    snprintf(str, len, "%" PRIu64, n);
+  } else {
+    snprintf(str, len, "%" PRIu64 "%c", v, suffixes[s]);
+  }
+}
+
+static void print_profile(const struct ProfileEntry* entries,
+                          const int count,
+                          const struct Options* options) {
+  char str[32];
+  int k;
+  if (options->format == FORMAT_JSON) {
+    printf("{\"platform_profile\": {");
+    for (k = 0; k < count; k++) {
+      printf("%s\"%s\": %" PRIu64, k > 0 ? ", " : "", entries[k].key,
+             entries[k].value);
+    }
+    printf("}}\n");
+    return;
+  }
+  printf("%splatform_profile\n", options->format == FORMAT_CSV ? "# " : "");
+  for (k = 0; k < count; k++) {
+    compact_count(str, sizeof(str), entries[k].value);
+    printf("%s%s=%s%s\n", options->format == FORMAT_CSV ? "# " : "",
+           entries[k].key, str, entries[k].unit[0] != '\0' ? "B" : "");
+  }
+}
+
+// Runs the sweeps that answer the usual questions about a new CPU, and prints
+// the knees as a profile of key=value lines that can be diffed between
+// machines: cache sizes (L1D, L2 ...), BTB levels (entries), the longest
+// branch pattern the predictor learns, and the copy size from which rep movsb
+// is at least as fast as an AVX copy loop.
+static void platform_profile(const unsigned max_logbytes,
+                             const struct Options* options) {
+  struct ProfileEntry entries[MAX_PROFILE_ENTRIES];
+  struct SweepInvocation si;
+  struct Sweep* s = (struct Sweep*)malloc(sizeof(struct Sweep));
+  char key[32];
+  int count = 0;
+  int k;
+
+  if (max_logbytes < MIN_LOG_CHASE_FOOTPRINT + 1 ||
+      max_logbytes > MAX_LOG_CHASE_FOOTPRINT) {
+    fprintf(stderr, "--platform_profile logb must be %d..%d\n",
+            MIN_LOG_CHASE_FOOTPRINT + 1, MAX_LOG_CHASE_FOOTPRINT);
+    exit(1);
+  }
+
+  // Caches: chase latency against footprint.
+  struct FootprintSweep fs;
+  memset(s, 0, sizeof(*s));
+  s->measure = measure_footprint;
+  s->arg = &fs;
+  s->lo = 1llu << MIN_LOG_CHASE_FOOTPRINT;
+  s->hi = 1llu << max_logbytes;
+  s->steps_per_octave = 2;
+  s->refine = 1;
+  s->lower_is_better = 1;
+  s->threshold = SWEEP_THRESHOLD;
+  fs.options = options;
+  fs.m = (char*)alloc_pages(s->hi, PAGES_THP);
+  if (fs.m == NULL) {
+    char str[MAX_BYTE_STRING_LENGTH];
+    size2string(str, s->hi);
+    fprintf(stderr, "Unable to allocate %s of THP footprint\n", str);
+    exit(1);
+  }
+  run_sweep(s);
+  free_pages(fs.m, s->hi, PAGES_THP);
+  print_knees("--load_latency", 1, s, options);
+  for (k = 0; k < s->knee_count; k++) {
+    snprintf(key, sizeof(key), k == 0 ? "L1D" : "L%d", k + 1);
+    add_profile_entry(entries, &count, key, round_capacity(s->knees[k]),
+                      "bytes");
+  }
+
+  // BTB: unconditional branch rate against 1 << logsize branches.
+  const unsigned int btb_params[MAX_TEST_ARGS] = {0};
+  memset(s, 0, sizeof(*s));
+  s->lo = 0;
+  s->hi = 16;
+  s->threshold = SWEEP_THRESHOLD;
+  memset(&si, 0, sizeof(si));
+  sweep_invocation(s, &si, "--btbcapacity", btb_params, 0, options);
+  print_knees("--btbcapacity", 1, s, options);
+  for (k = 0; k < s->knee_count; k++) {
+    snprintf(key, sizeof(key), "BTB%d", k + 1);
+    add_profile_entry(entries, &count, key, 1llu << s->knees[k], "");
+  }
+
+  // Branch history: the rate drops once a random taken/not taken pattern is
+  // too long for the predictor to learn. The test rounds N down to a power
+  // of 2.
+  const unsigned int history_params[MAX_TEST_ARGS] = {0};
+  memset(s, 0, sizeof(*s));
+  s->lo = 2;
+  s->hi = 1 << 20;
+  s->steps_per_octave = 1;
+  s->threshold = SWEEP_THRESHOLD;
+  memset(&si, 0, sizeof(si));
+  sweep_invocation(s, &si, "--branch_history", history_params, 0, options);
+  print_knees("--branch_history", 1, s, options);
+  if (s->knee_count > 0) {
+    add_profile_entry(entries, &count, "branch_history", s->knees[0], "");
+  }
+
+#if defined(__x86_64__)
+  // Copy GB/s of rep movsb and an AVX copy loop, aligned, 32 bytes to 1MB.
+  struct Sweep* avx = (struct Sweep*)malloc(sizeof(struct Sweep));
+  struct SweepInvocation avx_si;
+  const unsigned int rep_params[MAX_TEST_ARGS] = {1, 0, 0, 0, 0};
+  const unsigned int avx_params[MAX_TEST_ARGS] = {0, 0, 0, 0};
+  memset(s, 0, sizeof(*s));
+  s->lo = 32;
+  s->hi = 1 << 20;
+  s->steps_per_octave = 1;
+  s->threshold = SWEEP_THRESHOLD;
+  memset(&si, 0, sizeof(si));
+  sweep_invocation(s, &si, "--max_rep_movs", rep_params, 1, options);
+  *avx = *s;
+  memset(&avx_si, 0, sizeof(avx_si));
+  avx_si.log_arg = 1;
+  sweep_invocation(avx, &avx_si, "--maxavxcopy", avx_params, 0, options);
+  const uint64_t crossover = sweep_crossover(s, avx);
+  if (crossover > 0) {
+    add_profile_entry(entries, &count, "rep_movsb_wins_from", crossover,
+                      "bytes");
+  }
+  free(avx);
+#endif
+
+  print_profile(entries, count, options);
+  free(s);
 }
 
 int main(int argc, char* argv[]) {
@@ -52,64 +723,150 @@ int main(int argc, char* argv[]) {
     helpinfo();
   }
 
+  // Empty unless one of --threads, --cpus or --smt_pair is given, in which
+  // case every test after it runs concurrently on the listed cpus.
+  static struct CpuList cpus;
+  struct Options options = {0, 1, 0, 0, FORMAT_TEXT, 0, 0, 0, 0};
+  set_point_emitter(print_point, &options);
+
   for (i = 1; i < argc;) {
     if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
       helpinfo();
       break;
     }
-    int j;
-    int test_not_found = 1;
-    for (j = 0; j < NUMTESTS; j++) {
-      if (strchr(alltests[j].name, ' ') ?
-          (strncmp(argv[i],
-                   alltests[j].name,
-                   strchr(alltests[j].name, ' ') - alltests[j].name) == 0):
-          (strcmp(argv[i], alltests[j].name) == 0)) {
-        test_not_found = 0;
-        struct Result r;
-        switch (alltests[j].args) {
-          case 0:
-            r = alltests[j].function();
-            break;
-          case 1:
-            r = alltests[j].function(convert_or_crash(argv[i + 1]));
-            break;
-          case 2:
-            r = alltests[j].function(convert_or_crash(argv[i + 1]),
-                                     convert_or_crash(argv[i + 2]));
-            break;
-          case 3:
-            r = alltests[j].function(convert_or_crash(argv[i + 1]),
-                                     convert_or_crash(argv[i + 2]),
-                                     convert_or_crash(argv[i + 3]));
-            break;
-          case 4:
-            r = alltests[j].function(convert_or_crash(argv[i + 1]),
-                                     convert_or_crash(argv[i + 2]),
-                                     convert_or_crash(argv[i + 3]),
-                                     convert_or_crash(argv[i + 4]));
-            break;
-          case 5:
-            r = alltests[j].function(convert_or_crash(argv[i + 1]),
-                                     convert_or_crash(argv[i + 2]),
-                                     convert_or_crash(argv[i + 3]),
-                                     convert_or_crash(argv[i + 4]),
-                                     convert_or_crash(argv[i + 5]));
-            break;
-          default:
-            perror("Unsupported number of arguments\n");
-        };
-        printf("%s\tresulthash=%" PRIx64 "\t%s=%.6f\n", r.function,
-               r.resulthash, r.metricname, r.metric);
-        i += alltests[j].args;
-        break;
-      }
-    }
-    if (test_not_found) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      const unsigned int n = convert_or_crash(argv[i + 1]);
+      if (n == 0 || n > MAX_CPUS || !first_n_cpus(n, &cpus)) {
+        fprintf(stderr, "Unable to find %s cpus to run on\n", argv[i + 1]);
+        exit(1);
+      }
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+      if (!parse_cpu_list(argv[i + 1], &cpus)) {
+        fprintf(stderr, "%s is not a valid cpu list\n", argv[i + 1]);
+        exit(1);
+      }
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--smt_pair") == 0 && i + 1 < argc) {
+      if (!smt_pair(convert_or_crash(argv[i + 1]), &cpus)) {
+        fprintf(stderr, "cpu %s has no SMT sibling\n", argv[i + 1]);
+        exit(1);
+      }
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      options.warmup = convert_or_crash(argv[i + 1]);
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+      options.repetitions = convert_or_crash(argv[i + 1]);
+      if (options.repetitions < 1) {
+        fprintf(stderr, "--repetitions must be at least 1\n");
+        exit(1);
+      }
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--calibrate") == 0) {
+      options.ghz = estimate_ghz();
+      i += 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--mhz") == 0 && i + 1 < argc) {
+      options.ghz = convert_or_crash(argv[i + 1]) / 1000.0;
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--counters") == 0) {
+      options.counters = 1;
+      i += 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      if (strcmp(argv[i + 1], "text") == 0) {
+        options.format = FORMAT_TEXT;
+      } else if (strcmp(argv[i + 1], "csv") == 0) {
+        options.format = FORMAT_CSV;
+      } else if (strcmp(argv[i + 1], "json") == 0) {
+        options.format = FORMAT_JSON;
+      } else {
+        fprintf(stderr, "%s is not one of text, csv or json\n", argv[i + 1]);
+        exit(1);
+      }
+      i += 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--sweep") == 0 && i + 4 < argc) {
+      options.sweep_arg = convert_or_crash(argv[i + 1]);
+      options.sweep_lo = convert_or_crash(argv[i + 2]);
+      options.sweep_hi = convert_or_crash(argv[i + 3]);
+      options.sweep_steps = convert_or_crash(argv[i + 4]);
+      if (options.sweep_arg < 1 || options.sweep_lo > options.sweep_hi ||
+          (options.sweep_steps > 0 && options.sweep_lo == 0)) {
+        fprintf(stderr, "--sweep needs A >= 1, lo <= hi and lo > 0 if S > 0\n");
+        exit(1);
+      }
+      i += 5;
+      continue;
+    }
+    if (strcmp(argv[i], "--platform_profile") == 0 && i + 1 < argc) {
+      platform_profile(convert_or_crash(argv[i + 1]), &options);
+      fflush(stdout);
+      i += 2;
+      continue;
+    }
+    const struct Test* test = find_test(argv[i]);
+    if (test == NULL) {
       fprintf(stderr, "%s test not found\n", argv[i]);
       exit(1);
     }
-    ++i;
+    struct Invocation inv;
+    int k;
+    inv.test = test;
+    inv.options = &options;
+    if (test->args > MAX_TEST_ARGS || i + test->args >= argc) {
+      fprintf(stderr, "%s needs %d arguments\n", argv[i], test->args);
+      exit(1);
+    }
+    for (k = 0; k < test->args; k++) {
+      inv.params[k] = convert_or_crash(argv[i + 1 + k]);
+    }
+    if (options.sweep_arg > 0) {
+      // The value given for the swept argument is ignored.
+      if (options.sweep_arg > test->args || cpus.count > 0) {
+        fprintf(stderr, "%s can't sweep argument %d%s\n", argv[i],
+                options.sweep_arg, cpus.count > 0 ? " on several cpus" : "");
+        exit(1);
+      }
+      struct Sweep* s = (struct Sweep*)malloc(sizeof(struct Sweep));
+      struct SweepInvocation si;
+      memset(s, 0, sizeof(*s));
+      memset(&si, 0, sizeof(si));
+      s->lo = options.sweep_lo;
+      s->hi = options.sweep_hi;
+      s->steps_per_octave = options.sweep_steps;
+      s->refine = options.sweep_steps > 0;
+      s->threshold = SWEEP_THRESHOLD;
+      sweep_invocation(s, &si, argv[i], inv.params, options.sweep_arg - 1,
+                       &options);
+      print_knees(argv[i], options.sweep_arg, s, &options);
+      free(s);
+      options.sweep_arg = 0;
+    } else if (cpus.count > 0 && !pins_own_threads(test)) {
+      run_multicore(&inv, &cpus);
+    } else {
+      set_test_cpus(&cpus);
+      struct Result r = invoke_repeated(&inv);
+      print_result(&r, "", &options);
+    }
+    fflush(stdout);
+    i += test->args + 1;
   }
   return 0;
 }
@@ -64,6 +64,33 @@ struct Result btb_conditional_capacity(const int logsize, const int mask);
 struct Result stlf_dependent_pointer_chase(const uint32_t chasedepth);
 struct Result stlf_independent_pointer_chase(const uint32_t chasedepth);
 
+struct Result load_latency(const unsigned logbytes,
+                           const unsigned mode,
+                           const unsigned page_mode);
+struct Result load_latency_sweep(const unsigned min_logbytes,
+                                 const unsigned max_logbytes,
+                                 const unsigned mode,
+                                 const unsigned page_mode);
+
+struct Result c2c_latency(const int cpu_a, const int cpu_b);
+struct Result c2c_latency_matrix(const int maxcpus);
+struct Result atomic_contention(const int op,
+                                const int layout,
+                                const int maxthreads);
+
+struct Result mem_bandwidth(const unsigned pattern,
+                            const unsigned nt,
+                            const unsigned threads,
+                            const int node,
+                            const unsigned logbytes);
+struct Result loaded_latency(const unsigned pattern,
+                             const unsigned threads,
+                             const int node);
+
+struct Result simd_latency(const unsigned op, const unsigned width);
+struct Result simd_throughput(const unsigned op, const unsigned width);
+struct Result simd_license_drop(const unsigned width);
+
 struct Result rdtsc();
 struct Result rdtscp();
 
@@ -74,7 +101,7 @@ struct Test {
   struct Result (*function)();
 };
 
-#define NUMTESTS 29
+#define NUMTESTS 39
 
 const struct Test alltests[NUMTESTS] = {
   {"--alu_latency",
@@ -252,6 +279,79 @@ const struct Test alltests[NUMTESTS] = {
    1,
    "Tests basic store-to-load forwarding mechanism (no dependence)",
    (struct Result (*)())stlf_independent_pointer_chase
+  },
+
+  {"--load_latency logb mode pages",
+   3,
+   "Load to use latency over (1<<logb) bytes (logb=12..32, ns per load). "
+   "mode: 0=random 1=page_local 2=page_stride 3=sequential, "
+   "pages: 0=4KB 1=THP 2=2MB hugetlb 3=1GB hugetlb",
+   (struct Result (*)())load_latency
+  },
+
+  {"--load_latency_sweep minlogb maxlogb mode pages",
+   4,
+   "Prints load_latency (ns and cycles per load) at 2 footprints per octave "
+   "from (1<<minlogb) to (1<<maxlogb) bytes",
+   (struct Result (*)())load_latency_sweep
+  },
+
+  {"--c2c_latency A B",
+   2,
+   "Cacheline ping-pong between cpus A and B (ns per one way transfer)",
+   (struct Result (*)())c2c_latency
+  },
+
+  {"--c2c_latency_matrix N",
+   1,
+   "Prints core-to-core transfer latency between every pair of the first N "
+   "allowed cpus (N=0: all)",
+   (struct Result (*)())c2c_latency_matrix
+  },
+
+  {"--atomic_contention op layout N",
+   3,
+   "Throughput and ns per op of 1..N threads hammering an atomic. "
+   "op: 0=fetch_add 1=cas 2=ll/sc, "
+   "layout: 0=shared line 1=false sharing 2=padded",
+   (struct Result (*)())atomic_contention
+  },
+
+  {"--mem_bandwidth pattern nt N node logb",
+   5,
+   "GB/s of N threads streaming over (1<<logb) bytes per stream. "
+   "pattern: 0=read 1=write 2=copy 3=triad 4=update, nt: non-temporal stores, "
+   "node: numa node for buffers (-1 = local)",
+   (struct Result (*)())mem_bandwidth
+  },
+
+  {"--loaded_latency pattern N node",
+   3,
+   "Random load latency while N-1 threads generate increasing pattern "
+   "bandwidth (see --mem_bandwidth)",
+   (struct Result (*)())loaded_latency
+  },
+
+  {"--simd_latency op W",
+   2,
+   "Dependent width-W (128, 256, 512) SIMD op latency test "
+   "(GOPS=back-2-back-op-latency*GHz). op: 0=int_add 1=int_mul 2=fp_add "
+   "3=fp_mul 4=fma 5=shuffle 6=permute 7=gather 9=masked_load",
+   (struct Result (*)())simd_latency
+  },
+
+  {"--simd_throughput op W",
+   2,
+   "MAX width-W SIMD op throughput test (GOPS=IPC*GHz). op: as "
+   "--simd_latency, plus 8=scatter 10=masked_store",
+   (struct Result (*)())simd_throughput
+  },
+
+  {"--simd_license_drop W",
+   1,
+   "Percent drop in scalar clock while width-W FMAs run, and how long "
+   "the clock takes to recover",
+   (struct Result (*)())simd_license_drop
   }
 };
 
@@ -0,0 +1,312 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+#include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
+
+#define CHASE_LINE 64
+#define CHASE_PAGE 4096
+#define LINES_PER_PAGE (CHASE_PAGE / CHASE_LINE)
+#define CHASE_SEED 1220
+
+static uint64_t xorshift64(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void shuffle(uint32_t* a, const uint64_t n, uint64_t* state) {
+  uint64_t i;
+  for (i = n - 1; i > 0; i--) {
+    const uint64_t j = xorshift64(state) % (i + 1);
+    const uint32_t tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+  }
+}
+
+static const char* chase_mode_string(const int mode) {
+  switch (mode) {
+    case CHASE_RANDOM:
+      return "random";
+    case CHASE_PAGE_LOCAL:
+      return "page_local";
+    case CHASE_PAGE_STRIDE:
+      return "page_stride";
+    case CHASE_SEQUENTIAL:
+      return "sequential";
+    default:
+      return "unknown";
+  }
+}
+
+uint64_t* build_pointer_chain(char* m, const uint64_t bytes, const int mode) {
+  const uint64_t lines = bytes / CHASE_LINE;
+  const uint64_t pages = (lines + LINES_PER_PAGE - 1) / LINES_PER_PAGE;
+  uint64_t state = CHASE_SEED;
+  uint64_t n = 0;
+  uint64_t i, j;
+
+  // Line indices in visiting order. 32 bits covers 256GB of footprint.
+  uint32_t* order = (uint32_t*)malloc(sizeof(uint32_t) * lines);
+  uint32_t* page_order = (uint32_t*)malloc(sizeof(uint32_t) * pages);
+  if (order == NULL || page_order == NULL) {
+    perror("Unable to allocate pointer chain order\n");
+    abort();
+  }
+  for (i = 0; i < pages; i++) {
+    page_order[i] = i;
+  }
+  shuffle(page_order, pages, &state);
+
+  switch (mode) {
+    case CHASE_RANDOM:
+      for (n = 0; n < lines; n++) {
+        order[n] = n;
+      }
+      shuffle(order, lines, &state);
+      break;
+
+    case CHASE_PAGE_LOCAL:
+      for (i = 0; i < pages; i++) {
+        const uint64_t first = (uint64_t)page_order[i] * LINES_PER_PAGE;
+        const uint64_t count = (first + LINES_PER_PAGE <= lines ?
+                                LINES_PER_PAGE : lines - first);
+        for (j = 0; j < count; j++) {
+          order[n + j] = first + j;
+        }
+        shuffle(order + n, count, &state);
+        n += count;
+      }
+      break;
+
+    case CHASE_PAGE_STRIDE:
+      // Rotate the line within each page so that we don't pile all loads
+      // into the same cache set.
+      for (n = 0; n < pages; n++) {
+        const uint64_t line = ((uint64_t)page_order[n] * LINES_PER_PAGE +
+                               page_order[n] % LINES_PER_PAGE);
+        order[n] = line < lines ? line : (uint64_t)page_order[n] * LINES_PER_PAGE;
+      }
+      break;
+
+    case CHASE_SEQUENTIAL:
+      for (n = 0; n < lines; n++) {
+        order[n] = n;
+      }
+      break;
+
+    default:
+      assert(0);
+  }
+
+  for (i = 0; i < n; i++) {
+    uint64_t* line = (uint64_t*)(m + (uint64_t)order[i] * CHASE_LINE);
+    *line = (uint64_t)(m + (uint64_t)order[(i + 1) % n] * CHASE_LINE);
+  }
+  uint64_t* start = (uint64_t*)(m + (uint64_t)order[0] * CHASE_LINE);
+
+  free(page_order);
+  free(order);
+  return start;
+}
+
+double chase_ns_per_load(uint64_t** p, const uint64_t loads) {
+  register uint64_t* ptr = *p;
+  register uint64_t i;
+  uint64_t t = now_nsec();
+  for (i = 0; i < loads / LOOP64; i++) {
+    POINTER_CHASE(x64, ptr)
+  }
+  t = now_nsec() - t;
+  *p = ptr;
+  return (double)t / (loads / LOOP64 * LOOP64);
+}
+
+// Enough loads to run ~1 sec at each level of the hierarchy.
+static uint64_t loads_for_footprint(const uint64_t bytes) {
+  if (bytes <= (1llu << 20)) return LOOP64M;
+  if (bytes <= (1llu << 26)) return LOOP16M;
+  return LOOP4M;
+}
+
+double footprint_ns_per_load(char* m,
+                             const uint64_t bytes,
+                             const int mode,
+                             uint64_t* hash) {
+  uint64_t* p = build_pointer_chain(m, bytes, mode);
+
+  // One pass over the chain (capped) so that we measure steady state rather
+  // than cold misses and page faults.
+  const uint64_t chain = bytes / (mode == CHASE_PAGE_STRIDE ?
+                                  CHASE_PAGE : CHASE_LINE);
+  chase_ns_per_load(&p, (chain < LOOP4M ? chain : LOOP4M) + LOOP64);
+
+  timed_region_begin();
+  const double ns = chase_ns_per_load(&p, loads_for_footprint(bytes));
+  timed_region_end();
+  *hash = (uint64_t)p - (uint64_t)m;
+  return ns;
+}
+
+// The footprint kept while buffer_reuse() is on (see util.h).
+static __thread char* kept_footprint;
+static __thread uint64_t kept_footprint_bytes;
+static __thread int kept_footprint_page_mode;
+
+static char* acquire_footprint(const uint64_t bytes, const int page_mode) {
+  if (!buffer_reuse()) {
+    return (char*)alloc_pages(bytes, page_mode);
+  }
+  if (kept_footprint != NULL && kept_footprint_bytes >= bytes &&
+      kept_footprint_page_mode == page_mode) {
+    return kept_footprint;
+  }
+  if (kept_footprint != NULL) {
+    free_pages(kept_footprint, kept_footprint_bytes, kept_footprint_page_mode);
+  }
+  kept_footprint = (char*)alloc_pages(bytes, page_mode);
+  kept_footprint_bytes = kept_footprint == NULL ? 0 : bytes;
+  kept_footprint_page_mode = page_mode;
+  return kept_footprint;
+}
+
+static void release_footprint(char* m, const uint64_t bytes,
+                              const int page_mode) {
+  if (m != kept_footprint) {
+    free_pages(m, bytes, page_mode);
+  }
+}
+
+// Chases bytes of footprint in m, or in a footprint of its own if m is NULL.
+static struct Result chase_footprint(const char* name,
+                                     char* m,
+                                     const uint64_t bytes,
+                                     const int mode,
+                                     const int page_mode) {
+  struct Result result;
+  uint64_t hash = 0;
+  result.metric = 0;
+  result.resulthash = 0;
+  strcpy(result.metricname, "ns_per_load");
+
+  char* footprint = m != NULL ? m : acquire_footprint(bytes, page_mode);
+  if (footprint == NULL) {
+    snprintf(result.function, FN_NAME_LENGTH, "%s could not allocate %s",
+             name, page_mode_string(page_mode));
+    return result;
+  }
+  result.metric = footprint_ns_per_load(footprint, bytes, mode, &hash);
+  result.resulthash = hash;
+  if (m == NULL) {
+    release_footprint(footprint, bytes, page_mode);
+  }
+  return result;
+}
+
+struct Result load_latency(const unsigned logbytes,
+                           const unsigned mode,
+                           const unsigned page_mode) {
+  assert(logbytes >= MIN_LOG_CHASE_FOOTPRINT &&
+         logbytes <= MAX_LOG_CHASE_FOOTPRINT);
+  assert(mode <= CHASE_SEQUENTIAL);
+  assert(page_mode <= PAGES_HUGETLB_1GB);
+
+  struct Result result = chase_footprint(__FUNCTION__, NULL,
+                                         1llu << logbytes, mode, page_mode);
+  if (result.metric > 0) {
+    char str[MAX_BYTE_STRING_LENGTH];
+    byte2string(str, logbytes);
+    snprintf(result.function, FN_NAME_LENGTH, "%s(%.*s, %s, %s)",
+             __FUNCTION__, BYTE_STRING_CHARS, str, chase_mode_string(mode),
+             page_mode_string(page_mode));
+  }
+  return result;
+}
+
+struct Result load_latency_sweep(const unsigned min_logbytes,
+                                 const unsigned max_logbytes,
+                                 const unsigned mode,
+                                 const unsigned page_mode) {
+  assert(min_logbytes >= MIN_LOG_CHASE_FOOTPRINT &&
+         max_logbytes <= MAX_LOG_CHASE_FOOTPRINT &&
+         min_logbytes <= max_logbytes);
+  assert(mode <= CHASE_SEQUENTIAL);
+  assert(page_mode <= PAGES_HUGETLB_1GB);
+
+  struct Result result;
+  unsigned logbytes;
+  int half;
+  double sum = 0;
+  int64_t hash = 0;
+  int points = 0;
+
+  // Every footprint is chased in the largest one.
+  const uint64_t max_bytes = 1llu << max_logbytes;
+  char* m = (char*)alloc_pages(max_bytes, page_mode);
+  if (m == NULL) {
+    char maxstr[MAX_BYTE_STRING_LENGTH];
+    byte2string(maxstr, max_logbytes);
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s could not allocate %.*s of %s", __FUNCTION__,
+             BYTE_STRING_CHARS, maxstr, page_mode_string(page_mode));
+    result.metric = 0;
+    result.resulthash = 0;
+    strcpy(result.metricname, "ns_per_load");
+    return result;
+  }
+
+  // Two points per octave: 2^n and 1.5 x 2^n bytes.
+  for (logbytes = min_logbytes; logbytes <= max_logbytes; logbytes++) {
+    for (half = 0; half < 2; half++) {
+      if (half && logbytes == max_logbytes) break;
+      const uint64_t bytes = (1llu << logbytes) + (half ? (1llu << (logbytes - 1)) : 0);
+      char str[MAX_BYTE_STRING_LENGTH];
+      size2string(str, bytes);
+
+      result = chase_footprint(__FUNCTION__, m, bytes, mode, page_mode);
+      snprintf(result.function, FN_NAME_LENGTH, "%s(%.*s, %s, %s)",
+               __FUNCTION__, BYTE_STRING_CHARS, str, chase_mode_string(mode),
+               page_mode_string(page_mode));
+      emit_point(&result);
+      sum += result.metric;
+      hash += result.resulthash;
+      points++;
+    }
+  }
+
+  char minstr[MAX_BYTE_STRING_LENGTH];
+  char maxstr[MAX_BYTE_STRING_LENGTH];
+  byte2string(minstr, min_logbytes);
+  byte2string(maxstr, max_logbytes);
+  free_pages(m, max_bytes, page_mode);
+  // The points are above, this summarizes them.
+  result.metric = sum / points;
+  result.resulthash = hash;
+  snprintf(result.function, FN_NAME_LENGTH, "%s(%.*s-%.*s, %s, %s, mean)",
+           __FUNCTION__, BYTE_STRING_CHARS, minstr, BYTE_STRING_CHARS, maxstr,
+           chase_mode_string(mode), page_mode_string(page_mode));
+  return result;
+}
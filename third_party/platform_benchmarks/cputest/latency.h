@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_LATENCY_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_LATENCY_H_
+
+#include <stdint.h>
+
+#include "third_party/platform_benchmarks/util.h"
+
+// Order in which the pointer chain visits cachelines of the footprint.
+#define CHASE_RANDOM 0      // All lines, random order. Cache + TLB misses.
+#define CHASE_PAGE_LOCAL 1  // Pages in random order, all lines of a page in
+                            // random order before the next page. Mostly
+                            // cache misses, one TLB miss per 64 loads.
+#define CHASE_PAGE_STRIDE 2 // One line per 4KB page, pages in random order.
+                            // A TLB miss on every load (TLB reach).
+#define CHASE_SEQUENTIAL 3  // All lines, in address order. Prefetch friendly.
+
+#define MIN_LOG_CHASE_FOOTPRINT 12  // 4KB
+#define MAX_LOG_CHASE_FOOTPRINT 32  // 4GB
+
+#if defined(__x86_64__)
+
+#define POINTER_CHASE(x, p) asm volatile(x("mov (%0), %0\n\t") \
+                                         : "+r"(p)             \
+                                         :: "memory");
+
+#elif defined(__ppc64__)
+
+#define POINTER_CHASE(x, p) asm volatile(x("ld %0, 0(%0)\n\t") \
+                                         : "+b"(p)             \
+                                         :: "memory");
+
+#elif defined(__aarch64__)
+
+#define POINTER_CHASE(x, p) asm volatile(x("ldr %0, [%0]\n\t") \
+                                         : "+r"(p)             \
+                                         :: "memory");
+
+#endif
+
+// Builds a cyclic pointer chain over the cachelines of m (bytes long) in the
+// order given by mode, and returns its first element.
+uint64_t* build_pointer_chain(char* m, const uint64_t bytes, const int mode);
+
+// Chases loads links of the chain from *p, leaving *p where it stopped.
+// Returns average ns per dependent load.
+double chase_ns_per_load(uint64_t** p, const uint64_t loads);
+
+// Average ns per dependent load chasing a mode chain over the first bytes of
+// m. *hash is set to where the chase stopped.
+double footprint_ns_per_load(char* m,
+                             const uint64_t bytes,
+                             const int mode,
+                             uint64_t* hash);
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_LATENCY_H_
@@ -131,11 +131,52 @@ struct Result max_scalar_memop_ipc(const unsigned load) {
 }
 
 
+// A buffer kept across calls while buffer_reuse() is on (see util.h), so
+// that a sweep doesn't allocate and fault in a new buffer for every point.
+// The largest one so far is handed out, and only ever grown.
+struct ReusedBuffer {
+  void* m;
+  uint64_t size;
+};
+
+static __thread struct ReusedBuffer copy_buffer;
+static __thread struct ReusedBuffer footprint_buffer;
+
+// Returns 1 if *memref is newly allocated, 0 if it is the kept buffer and
+// -1 if it cannot be allocated. Hand it back with release_buffer().
+static int acquire_buffer(struct ReusedBuffer* b, const uint64_t size,
+                          const int alignment, void** memref) {
+  if (!buffer_reuse()) {
+    return posix_memalign(memref, alignment, size) == 0 ? 1 : -1;
+  }
+  if (b->m != NULL && b->size >= size) {
+    *memref = b->m;
+    return 0;
+  }
+  free(b->m);
+  b->m = NULL;
+  b->size = 0;
+  if (posix_memalign(&b->m, alignment, size) != 0) {
+    b->m = NULL;
+    return -1;
+  }
+  b->size = size;
+  *memref = b->m;
+  return 1;
+}
+
+static void release_buffer(struct ReusedBuffer* b, void* m) {
+  if (m != b->m) {
+    free(m);
+  }
+}
+
 uint64_t allocate_for_copy(const unsigned copy_size,
                            const int cacheline_size,
                            void **memref) {
   // returns outer loop count for test.
   // Returns 0 if cannot allocate.
+  // Hand the buffer back with release_buffer(&copy_buffer, *memref).
 
   assert(copy_size <= (1u << MAX_LOG_COPYSIZE));
 
@@ -150,7 +191,7 @@ uint64_t allocate_for_copy(const unsigned copy_size,
 
   uint64_t allocsize = 2 * copy_size + 2 * cacheline_size;
 
-  if (posix_memalign(memref, cacheline_size, allocsize) != 0) {
+  if (acquire_buffer(&copy_buffer, allocsize, cacheline_size, memref) < 0) {
     perror("Unable to align to cacheline size\n");
     return 0llu;
   }
@@ -226,6 +267,7 @@ struct Result max_rep_movs(const int data_size,
                                                          (void **)&m);
   if (outer_loop_count == 0) {
     sprintf(result.function, "%s could not allocate memory", __FUNCTION__);
+    return result;
   }
 
   register uint64_t copy_count = (copy_size / data_size);
@@ -253,6 +295,7 @@ struct Result max_rep_movs(const int data_size,
          (data_size & (data_size - 1)) == 0 &&
          (df == 0 || df == 1));
 
+  timed_region_begin();
   uint64_t t = now_nsec();
 
   switch ((df << 4) | data_size) {
@@ -337,6 +380,7 @@ struct Result max_rep_movs(const int data_size,
 
   result.metric = ((double)outer_loop_count *
                    copy_size / (now_nsec() - t));
+  timed_region_end();
   result.resulthash = (src_pointer << 32) |
                       (dst_pointer & (((uint64_t)1 << 32) - 1));
   strcpy(result.metricname, "GBPS");
@@ -346,6 +390,7 @@ struct Result max_rep_movs(const int data_size,
           "%s(dsize: %d, cpsize: %d,\tsrcalign: %d, dstalign: %d, df: %d)",
           __FUNCTION__, data_size, copy_size,
           src_align, dst_align, df);
+  release_buffer(&copy_buffer, m);
 #endif
 
   return result;
@@ -447,6 +492,7 @@ struct Result max_avx_copy(const int log_copy_size,
                     (((dst_align & 0x1f) != 0 || force_unaligned_memop) ? 0 : 1));
 
   register uint64_t loop_counter = outer_loop_count;
+  timed_region_begin();
   uint64_t t = now_nsec();
 
   switch (switch_key) {
@@ -550,6 +596,7 @@ struct Result max_avx_copy(const int log_copy_size,
 
   result.metric = ((double)outer_loop_count *
                    (1 << log_copy_size) / (now_nsec() - t));
+  timed_region_end();
   result.resulthash = (src_pointer << 32) |
       (dst_pointer & (((uint64_t)1 << 32) - 1));
   strcpy(result.metricname, "GBPS");
@@ -560,6 +607,7 @@ struct Result max_avx_copy(const int log_copy_size,
   sprintf(result.function,
           "%s(cpsize: %s,\tsrcalign: %d, dstalign: %d)",
           __FUNCTION__, bytesstring, src_align, dst_align);
+  release_buffer(&copy_buffer, m);
 #endif
 
   return result;
@@ -605,7 +653,9 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
   // completely compromise replacement policy even if footprint is
   // contained in the cache.
   uint64_t* m;
-  if (posix_memalign((void **)&m, MAX_CACHELINE_SIZE, (1<<logbytes))!=0) {
+  const int allocated = acquire_buffer(&footprint_buffer, 1llu << logbytes,
+                                       MAX_CACHELINE_SIZE, (void **)&m);
+  if (allocated < 0) {
     perror("Unable to align to cacheline size\n");
     abort();
   }
@@ -614,7 +664,10 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
   // a. lazy allocation
   // b. compression for higher bandwidth
   // Doesn't seem to be necessary with GRTE but need it for other environments
-  randmemset(m, 1<<logbytes, RAND_SEED);
+  // A reused buffer has been filled already.
+  if (allocated) {
+    randmemset(m, 1llu << logbytes, RAND_SEED);
+  }
 
   register uint64_t i;
   register uint64_t loop_count;
@@ -643,6 +696,7 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
 
   register uint64_t index;
 
+  timed_region_begin();
   uint64_t t = now_nsec();
   if (load) {
     for (i=0; i < outerloopcount; i++) {
@@ -659,6 +713,7 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
   result.resulthash = outerloopcount;
   strcpy(result.metricname, load? "Billion_32_byte_loads_per_sec" : "Billion_32_byte_stores_per_sec");
   result.metric = (double)outerloopcount*(1<<(logbytes-5))/(now_nsec()-t);
+  timed_region_end();
 
 #elif defined(__ppc64__)
 
@@ -686,6 +741,7 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
   register uint64_t reg14 asm("r9");
   register uint64_t reg15 asm("r10");
 
+  timed_region_begin();
   uint64_t t = now_nsec();
   if (load) {
     for (i=0; i < outerloopcount; i++) {
@@ -700,6 +756,7 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
     }
   }
   result.metric = (double)outerloopcount*(1<<(logbytes-4))/(now_nsec()-t);
+  timed_region_end();
   result.resulthash = outerloopcount;
   strcpy(result.metricname, load? "Billion_16_byte_loads_per_sec" : "Billion_16_byte_stores_per_sec");
 
@@ -714,6 +771,7 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
 
   register uint64_t index0, index1, index2, index3, post_index;
 
+  timed_region_begin();
   uint64_t t = now_nsec();
   if (load) {
     for (i=0; i < outerloopcount; i++) {
@@ -732,9 +790,11 @@ struct Result max_vector_memops_at_footprint(const unsigned load, const unsigned
     }
   }
   result.metric = (double)outerloopcount*(1<<(logbytes-4))/(now_nsec()-t);
+  timed_region_end();
   result.resulthash = outerloopcount;
   strcpy(result.metricname, load? "Billion_16_byte_loads_per_sec" : "Billion_16_byte_stores_per_sec");
 
 #endif
+  release_buffer(&footprint_buffer, m);
   return result;
 }
@@ -0,0 +1,495 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "latency.h"
+#include "membw.h"
+#include "multicore.h"
+#include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
+
+// From <numaif.h>. We make the syscalls directly rather than depend on
+// libnuma.
+#define MPOL_BIND 2
+#define MAX_NUMA_NODES 1024
+
+#define MAX_STREAMS 3
+
+// Bytes each mem_bandwidth thread moves, so that a run takes ~1 sec.
+#define BYTES_PER_THREAD (1llu << 33)
+
+// Loaded latency: the chaser walks a random chain over CHASER_BYTES while
+// every other thread streams over its own GENERATOR_BYTES, BLOCK_BYTES at a
+// time with a spin of delay iterations between blocks.
+#define CHASER_BYTES (1llu << 29)
+#define CHASER_LOADS LOOP4M
+#define GENERATOR_BYTES (1llu << 27)
+#define BLOCK_BYTES 4096
+#define IDLE -1
+
+// Generator throttle per step, from unloaded to flat out.
+static const int loaded_delays[] = {IDLE, 16384, 4096, 1024, 256, 64, 16, 0};
+#define NUM_LOAD_STEPS (sizeof(loaded_delays) / sizeof(loaded_delays[0]))
+
+static const char* pattern_string(const int pattern) {
+  switch (pattern) {
+    case STREAM_READ:
+      return "read";
+    case STREAM_WRITE:
+      return "write";
+    case STREAM_COPY:
+      return "copy";
+    case STREAM_TRIAD:
+      return "triad";
+    case STREAM_UPDATE:
+      return "update";
+    default:
+      return "unknown";
+  }
+}
+
+static int stream_count(const int pattern) {
+  switch (pattern) {
+    case STREAM_COPY:
+      return 2;
+    case STREAM_TRIAD:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+// Bytes loaded plus bytes stored for every byte of stream length.
+static int bytes_moved_per_byte(const int pattern) {
+  switch (pattern) {
+    case STREAM_READ:
+    case STREAM_WRITE:
+      return 1;
+    case STREAM_TRIAD:
+      return 3;
+    default:
+      return 2;
+  }
+}
+
+static int bind_to_node(void* p, const uint64_t bytes, const int node) {
+  unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+  memset(mask, 0, sizeof(mask));
+  mask[node / (8 * sizeof(unsigned long))] |=
+      1lu << (node % (8 * sizeof(unsigned long)));
+  return syscall(SYS_mbind, p, bytes, MPOL_BIND, mask, MAX_NUMA_NODES, 0);
+}
+
+// node if we can place memory there, otherwise NODE_LOCAL. Single node
+// machines, kernels without NUMA and containers that forbid mbind all end up
+// local.
+static int resolve_node(const int node) {
+  char path[64];
+  int status = -1;
+
+  if (node < 0 || node >= MAX_NUMA_NODES) return NODE_LOCAL;
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+  if (access(path, F_OK) != 0) return NODE_LOCAL;
+
+  void* p = alloc_pages(4096, PAGES_4KB);
+  if (p == NULL) return NODE_LOCAL;
+  if (bind_to_node(p, 4096, node) == 0) {
+    memset(p, 1, 4096);
+    // Ask where the page actually landed.
+    if (syscall(SYS_move_pages, 0, 1, &p, NULL, &status, 0) != 0) {
+      status = -1;
+    }
+  }
+  free_pages(p, 4096, PAGES_4KB);
+  return status == node ? node : NODE_LOCAL;
+}
+
+// Longest node_string(): "local, node -2147483648 unavailable".
+#define NODE_STRING_LENGTH 40
+
+static void node_string(char* str, const int requested, const int node) {
+  if (node != NODE_LOCAL) {
+    sprintf(str, "node %d", node);
+  } else if (requested < 0) {
+    strcpy(str, "local");
+  } else {
+    sprintf(str, "local, node %d unavailable", requested);
+  }
+}
+
+// THP backed where possible so that we measure DRAM rather than page walks.
+static char* alloc_stream(const uint64_t bytes, const int node,
+                          int* page_mode) {
+  *page_mode = PAGES_THP;
+  char* p = (char*)alloc_pages(bytes, PAGES_THP);
+  if (p == NULL) {
+    *page_mode = PAGES_4KB;
+    p = (char*)alloc_pages(bytes, PAGES_4KB);
+  }
+  if (p == NULL) {
+    perror("Unable to allocate stream buffer\n");
+    abort();
+  }
+  if (node != NODE_LOCAL && bind_to_node(p, bytes, node) != 0) {
+    perror("mbind");
+  }
+  return p;
+}
+
+// One pass of pattern over n bytes of each stream, starting at offset.
+static void stream_pass(const int pattern, const int nt, char** streams,
+                        const uint64_t offset, uint64_t n) {
+#ifdef STREAM_KERNELS_SUPPORTED
+  char* a = streams[0] + offset;
+  char* b = streams[1] == NULL ? NULL : streams[1] + offset;
+  char* c = streams[2] == NULL ? NULL : streams[2] + offset;
+
+  switch (pattern) {
+    case STREAM_READ:
+      STREAM_READ_KERNEL(a, n)
+      break;
+
+    case STREAM_WRITE:
+      if (nt) {
+        STREAM_WRITE_KERNEL(STREAM_NT_STORE, a, n)
+      } else {
+        STREAM_WRITE_KERNEL(STREAM_STORE, a, n)
+      }
+      break;
+
+    case STREAM_COPY:
+      if (nt) {
+        STREAM_COPY_KERNEL(STREAM_NT_STORE, a, b, n)
+      } else {
+        STREAM_COPY_KERNEL(STREAM_STORE, a, b, n)
+      }
+      break;
+
+    case STREAM_TRIAD:
+      if (nt) {
+        STREAM_TRIAD_KERNEL(STREAM_NT_STORE, a, b, c, n)
+      } else {
+        STREAM_TRIAD_KERNEL(STREAM_STORE, a, b, c, n)
+      }
+      break;
+
+    case STREAM_UPDATE:
+      if (nt) {
+        STREAM_UPDATE_KERNEL(STREAM_NT_STORE, a, n)
+      } else {
+        STREAM_UPDATE_KERNEL(STREAM_STORE, a, n)
+      }
+      break;
+
+    default:
+      assert(0);
+  }
+  if (nt) {
+    STREAM_FENCE()
+  }
+#endif
+}
+
+struct Streams {
+  char* p[MAX_STREAMS];
+  int page_mode[MAX_STREAMS];
+};
+
+static void alloc_streams(struct Streams* s, const int pattern,
+                          const uint64_t bytes, const int node) {
+  int k;
+  for (k = 0; k < MAX_STREAMS; k++) {
+    s->p[k] = NULL;
+    if (k < stream_count(pattern)) {
+      s->p[k] = alloc_stream(bytes, node, &s->page_mode[k]);
+      memset(s->p[k], k + 1, bytes);  // First touch, from the pinned thread.
+    }
+  }
+}
+
+static void free_streams(struct Streams* s, const uint64_t bytes) {
+  int k;
+  for (k = 0; k < MAX_STREAMS; k++) {
+    if (s->p[k] != NULL) free_pages(s->p[k], bytes, s->page_mode[k]);
+  }
+}
+
+struct Bandwidth {
+  int pattern;
+  int nt;
+  int node;
+  uint64_t bytes;
+  uint64_t passes;
+  pthread_barrier_t ready;
+};
+
+static struct Result stream_worker(void* arg) {
+  struct Bandwidth* bw = (struct Bandwidth*)arg;
+  struct Result result;
+  struct Streams s;
+  uint64_t i;
+
+  alloc_streams(&s, bw->pattern, bw->bytes, bw->node);
+  stream_pass(bw->pattern, bw->nt, s.p, 0, bw->bytes);
+
+  // Everyone allocated and warmed up before anyone starts the clock.
+  pthread_barrier_wait(&bw->ready);
+  uint64_t t = now_nsec();
+  for (i = 0; i < bw->passes; i++) {
+    stream_pass(bw->pattern, bw->nt, s.p, 0, bw->bytes);
+  }
+  t = now_nsec() - t;
+
+  result.metric = (double)(bw->bytes * bytes_moved_per_byte(bw->pattern) *
+                           bw->passes) / t;
+  result.resulthash = (uint64_t)s.p[0][bw->bytes - 1];
+  free_streams(&s, bw->bytes);
+  return result;
+}
+
+struct Result mem_bandwidth(const unsigned pattern,
+                            const unsigned nt,
+                            const unsigned threads,
+                            const int node,
+                            const unsigned logbytes) {
+  assert(pattern <= STREAM_UPDATE);
+  assert(nt <= 1);
+  assert(threads >= 1 && threads <= MAX_CPUS);
+  assert(logbytes >= MIN_LOG_STREAM_BYTES && logbytes <= MAX_LOG_STREAM_BYTES);
+
+  struct Result result;
+  result.resulthash = 0;
+  result.metric = 0;
+  strcpy(result.metricname, "GB_per_sec");
+
+#ifndef STREAM_KERNELS_SUPPORTED
+  sprintf(result.function, "%s NOT APPLICABLE on Current Platform",
+          __FUNCTION__);
+  return result;
+#else
+  if (!STREAM_KERNELS_RUNNABLE()) {
+    sprintf(result.function, "%s NOT APPLICABLE on Current Platform (no %s)",
+            __FUNCTION__, STREAM_KERNELS_ISA);
+    return result;
+  }
+#endif
+
+  struct CpuList* cpus = (struct CpuList*)malloc(sizeof(struct CpuList));
+  if (test_cpus(threads, cpus) == 0) {
+    sprintf(result.function, "%s needs %u cpus, have %d", __FUNCTION__,
+            threads, cpus->count);
+    free(cpus);
+    return result;
+  }
+
+  struct Bandwidth bw;
+  struct Result* results =
+      (struct Result*)malloc(sizeof(struct Result) * threads);
+  const uint64_t per_pass =
+      (1llu << logbytes) * bytes_moved_per_byte(pattern);
+  unsigned k;
+
+  bw.pattern = pattern;
+  bw.nt = nt;
+  bw.node = resolve_node(node);
+  bw.bytes = 1llu << logbytes;
+  bw.passes = BYTES_PER_THREAD > per_pass ? BYTES_PER_THREAD / per_pass : 1;
+  pthread_barrier_init(&bw.ready, NULL, threads);
+  run_on_cpus(cpus, stream_worker, &bw, results);
+  pthread_barrier_destroy(&bw.ready);
+
+  for (k = 0; k < threads; k++) {
+    result.metric += results[k].metric;
+    result.resulthash += results[k].resulthash;
+  }
+
+  char str[MAX_BYTE_STRING_LENGTH];
+  char nodestr[NODE_STRING_LENGTH];
+  byte2string(str, logbytes);
+  node_string(nodestr, node, bw.node);
+  snprintf(result.function, FN_NAME_LENGTH,
+           "%s(%s, %s stores, threads=%u, %s, %.*s per stream)", __FUNCTION__,
+           pattern_string(pattern), nt ? "non-temporal" : "temporal",
+           threads, nodestr, BYTE_STRING_CHARS, str);
+  free(results);
+  free(cpus);
+  return result;
+}
+
+struct Loaded {
+  int pattern;
+  int node;
+  int threads;
+  uint64_t next_id;
+  int stop;
+  double* gbps;  // [step * threads + id], generators only.
+  pthread_barrier_t start;
+  pthread_barrier_t end;
+  char nodestr[NODE_STRING_LENGTH];
+};
+
+static void spin(const int iterations) {
+  int i;
+  for (i = 0; i < iterations; i++) {
+    asm volatile("" ::: "memory");
+  }
+}
+
+static struct Result chaser(struct Loaded* ld) {
+  struct Result result;
+  int page_mode;
+  unsigned step;
+
+  char* m = alloc_stream(CHASER_BYTES, ld->node, &page_mode);
+  uint64_t* p = build_pointer_chain(m, CHASER_BYTES, CHASE_RANDOM);
+  chase_ns_per_load(&p, CHASER_LOADS);
+
+  for (step = 0; step < NUM_LOAD_STEPS; step++) {
+    if (ld->threads == 1 && loaded_delays[step] != IDLE) break;
+
+    pthread_barrier_wait(&ld->start);
+    result.metric = chase_ns_per_load(&p, CHASER_LOADS);
+    __atomic_store_n(&ld->stop, 1, __ATOMIC_RELAXED);
+    pthread_barrier_wait(&ld->end);
+
+    double gbps = 0;
+    int k;
+    for (k = 1; k < ld->threads; k++) {
+      gbps += ld->gbps[step * ld->threads + k];
+    }
+    result.resulthash = (uint64_t)p - (uint64_t)m;
+    snprintf(result.function, FN_NAME_LENGTH,
+             "loaded_latency(%s, generators=%d, %s, %.1f GB/s)",
+             pattern_string(ld->pattern), ld->threads - 1, ld->nodestr, gbps);
+    strcpy(result.metricname, "ns_per_load");
+    emit_point(&result);
+    // Generators can't pass the next start barrier until we get there.
+    __atomic_store_n(&ld->stop, 0, __ATOMIC_RELAXED);
+  }
+
+  result.resulthash = (uint64_t)p - (uint64_t)m;
+  free_pages(m, CHASER_BYTES, page_mode);
+  return result;
+}
+
+static struct Result generator(struct Loaded* ld, const int id) {
+  struct Result result;
+  struct Streams s;
+  unsigned step;
+
+  alloc_streams(&s, ld->pattern, GENERATOR_BYTES, ld->node);
+
+  for (step = 0; step < NUM_LOAD_STEPS; step++) {
+    const int delay = loaded_delays[step];
+    uint64_t offset = 0;
+    uint64_t moved = 0;
+
+    pthread_barrier_wait(&ld->start);
+    uint64_t t = now_nsec();
+    while (delay != IDLE && !__atomic_load_n(&ld->stop, __ATOMIC_RELAXED)) {
+      stream_pass(ld->pattern, 0, s.p, offset, BLOCK_BYTES);
+      moved += BLOCK_BYTES * bytes_moved_per_byte(ld->pattern);
+      offset = (offset + BLOCK_BYTES) % GENERATOR_BYTES;
+      spin(delay);
+    }
+    ld->gbps[step * ld->threads + id] = (double)moved / (now_nsec() - t);
+    pthread_barrier_wait(&ld->end);
+  }
+
+  result.metric = 0;
+  result.resulthash = (uint64_t)s.p[0][0];
+  free_streams(&s, GENERATOR_BYTES);
+  return result;
+}
+
+static struct Result loaded_worker(void* arg) {
+  struct Loaded* ld = (struct Loaded*)arg;
+  const uint64_t id = __atomic_fetch_add(&ld->next_id, 1, __ATOMIC_RELAXED);
+  return id == 0 ? chaser(ld) : generator(ld, id);
+}
+
+struct Result loaded_latency(const unsigned pattern,
+                             const unsigned threads,
+                             const int node) {
+  assert(pattern <= STREAM_UPDATE);
+  assert(threads >= 1 && threads <= MAX_CPUS);
+
+  struct Result result;
+  result.resulthash = 0;
+  result.metric = 0;
+  strcpy(result.metricname, "ns_per_load");
+
+#ifndef STREAM_KERNELS_SUPPORTED
+  sprintf(result.function, "%s NOT APPLICABLE on Current Platform",
+          __FUNCTION__);
+  return result;
+#else
+  if (!STREAM_KERNELS_RUNNABLE()) {
+    sprintf(result.function, "%s NOT APPLICABLE on Current Platform (no %s)",
+            __FUNCTION__, STREAM_KERNELS_ISA);
+    return result;
+  }
+#endif
+
+  struct CpuList* cpus = (struct CpuList*)malloc(sizeof(struct CpuList));
+  if (test_cpus(threads, cpus) == 0) {
+    sprintf(result.function, "%s needs %u cpus, have %d", __FUNCTION__,
+            threads, cpus->count);
+    free(cpus);
+    return result;
+  }
+
+  struct Loaded ld;
+  struct Result* results =
+      (struct Result*)malloc(sizeof(struct Result) * threads);
+
+  ld.pattern = pattern;
+  ld.node = resolve_node(node);
+  ld.threads = threads;
+  ld.next_id = 0;
+  ld.stop = 0;
+  ld.gbps = (double*)calloc(NUM_LOAD_STEPS * threads, sizeof(double));
+  pthread_barrier_init(&ld.start, NULL, threads);
+  pthread_barrier_init(&ld.end, NULL, threads);
+  node_string(ld.nodestr, node, ld.node);
+
+  run_on_cpus(cpus, loaded_worker, &ld, results);
+
+  pthread_barrier_destroy(&ld.start);
+  pthread_barrier_destroy(&ld.end);
+
+  // Latency at the heaviest load we generated.
+  unsigned k;
+  for (k = 0; k < threads; k++) {
+    result.metric += results[k].metric;
+    result.resulthash += results[k].resulthash;
+  }
+  snprintf(result.function, FN_NAME_LENGTH, "%s(%s, generators=%u, %s)",
+           __FUNCTION__, pattern_string(pattern), threads - 1, ld.nodestr);
+  free(ld.gbps);
+  free(results);
+  free(cpus);
+  return result;
+}
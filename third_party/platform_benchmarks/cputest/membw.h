@@ -0,0 +1,243 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MEMBW_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MEMBW_H_
+
+#include "third_party/platform_benchmarks/util.h"
+
+// Access pattern of each mem_bandwidth thread. Bytes moved count every byte
+// loaded and every byte stored once (write-allocate reads not included).
+#define STREAM_READ 0    // 1 read stream
+#define STREAM_WRITE 1   // 1 write stream
+#define STREAM_COPY 2    // 1 read : 1 write
+#define STREAM_TRIAD 3   // 2 read : 1 write (c = a + b)
+#define STREAM_UPDATE 4  // 1 read : 1 write, same addresses (a = a + a)
+
+// Each kernel consumes 128 bytes per stream per iteration, so len must be a
+// multiple of 128 bytes. ST is the store mnemonic, STREAM_STORE or
+// STREAM_NT_STORE.
+
+#if defined(__x86_64__)
+
+#define STREAM_KERNELS_SUPPORTED 1
+// The kernels use 256 bit integer ops, check before running them.
+#define STREAM_KERNELS_ISA "avx2"
+#define STREAM_KERNELS_RUNNABLE() __builtin_cpu_supports(STREAM_KERNELS_ISA)
+#define STREAM_STORE "vmovdqa"
+#define STREAM_NT_STORE "vmovntdq"
+#define STREAM_FENCE() asm volatile("sfence\n\t" ::: "memory");
+
+#define STREAM_READ_KERNEL(src, len)                            \
+  asm volatile("1:\n\t"                                         \
+               "vmovdqa 0x00(%[s]), %%ymm0\n\t"                 \
+               "vmovdqa 0x20(%[s]), %%ymm1\n\t"                 \
+               "vmovdqa 0x40(%[s]), %%ymm2\n\t"                 \
+               "vmovdqa 0x60(%[s]), %%ymm3\n\t"                 \
+               "add $0x80, %[s]\n\t"                            \
+               "sub $0x80, %[n]\n\t"                            \
+               "jnz 1b\n\t"                                     \
+               : [s]"+r"(src), [n]"+r"(len)                     \
+               :: "%ymm0", "%ymm1", "%ymm2", "%ymm3", "cc", "memory");
+
+#define STREAM_WRITE_KERNEL(ST, dst, len)                       \
+  asm volatile("vpxor %%ymm0, %%ymm0, %%ymm0\n\t"               \
+               "1:\n\t"                                         \
+               ST " %%ymm0, 0x00(%[d])\n\t"                     \
+               ST " %%ymm0, 0x20(%[d])\n\t"                     \
+               ST " %%ymm0, 0x40(%[d])\n\t"                     \
+               ST " %%ymm0, 0x60(%[d])\n\t"                     \
+               "add $0x80, %[d]\n\t"                            \
+               "sub $0x80, %[n]\n\t"                            \
+               "jnz 1b\n\t"                                     \
+               : [d]"+r"(dst), [n]"+r"(len)                     \
+               :: "%ymm0", "cc", "memory");
+
+#define STREAM_COPY_KERNEL(ST, src, dst, len)                   \
+  asm volatile("1:\n\t"                                         \
+               "vmovdqa 0x00(%[s]), %%ymm0\n\t"                 \
+               "vmovdqa 0x20(%[s]), %%ymm1\n\t"                 \
+               "vmovdqa 0x40(%[s]), %%ymm2\n\t"                 \
+               "vmovdqa 0x60(%[s]), %%ymm3\n\t"                 \
+               ST " %%ymm0, 0x00(%[d])\n\t"                     \
+               ST " %%ymm1, 0x20(%[d])\n\t"                     \
+               ST " %%ymm2, 0x40(%[d])\n\t"                     \
+               ST " %%ymm3, 0x60(%[d])\n\t"                     \
+               "add $0x80, %[s]\n\t"                            \
+               "add $0x80, %[d]\n\t"                            \
+               "sub $0x80, %[n]\n\t"                            \
+               "jnz 1b\n\t"                                     \
+               : [s]"+r"(src), [d]"+r"(dst), [n]"+r"(len)       \
+               :: "%ymm0", "%ymm1", "%ymm2", "%ymm3", "cc", "memory");
+
+#define STREAM_TRIAD_KERNEL(ST, src1, src2, dst, len)           \
+  asm volatile("1:\n\t"                                         \
+               "vmovdqa 0x00(%[a]), %%ymm0\n\t"                 \
+               "vmovdqa 0x20(%[a]), %%ymm1\n\t"                 \
+               "vmovdqa 0x40(%[a]), %%ymm2\n\t"                 \
+               "vmovdqa 0x60(%[a]), %%ymm3\n\t"                 \
+               "vpaddq 0x00(%[b]), %%ymm0, %%ymm0\n\t"          \
+               "vpaddq 0x20(%[b]), %%ymm1, %%ymm1\n\t"          \
+               "vpaddq 0x40(%[b]), %%ymm2, %%ymm2\n\t"          \
+               "vpaddq 0x60(%[b]), %%ymm3, %%ymm3\n\t"          \
+               ST " %%ymm0, 0x00(%[d])\n\t"                     \
+               ST " %%ymm1, 0x20(%[d])\n\t"                     \
+               ST " %%ymm2, 0x40(%[d])\n\t"                     \
+               ST " %%ymm3, 0x60(%[d])\n\t"                     \
+               "add $0x80, %[a]\n\t"                            \
+               "add $0x80, %[b]\n\t"                            \
+               "add $0x80, %[d]\n\t"                            \
+               "sub $0x80, %[n]\n\t"                            \
+               "jnz 1b\n\t"                                     \
+               : [a]"+r"(src1), [b]"+r"(src2), [d]"+r"(dst), [n]"+r"(len) \
+               :: "%ymm0", "%ymm1", "%ymm2", "%ymm3", "cc", "memory");
+
+#define STREAM_UPDATE_KERNEL(ST, ptr, len)                      \
+  asm volatile("1:\n\t"                                         \
+               "vmovdqa 0x00(%[p]), %%ymm0\n\t"                 \
+               "vmovdqa 0x20(%[p]), %%ymm1\n\t"                 \
+               "vmovdqa 0x40(%[p]), %%ymm2\n\t"                 \
+               "vmovdqa 0x60(%[p]), %%ymm3\n\t"                 \
+               "vpaddq %%ymm0, %%ymm0, %%ymm0\n\t"              \
+               "vpaddq %%ymm1, %%ymm1, %%ymm1\n\t"              \
+               "vpaddq %%ymm2, %%ymm2, %%ymm2\n\t"              \
+               "vpaddq %%ymm3, %%ymm3, %%ymm3\n\t"              \
+               ST " %%ymm0, 0x00(%[p])\n\t"                     \
+               ST " %%ymm1, 0x20(%[p])\n\t"                     \
+               ST " %%ymm2, 0x40(%[p])\n\t"                     \
+               ST " %%ymm3, 0x60(%[p])\n\t"                     \
+               "add $0x80, %[p]\n\t"                            \
+               "sub $0x80, %[n]\n\t"                            \
+               "jnz 1b\n\t"                                     \
+               : [p]"+r"(ptr), [n]"+r"(len)                     \
+               :: "%ymm0", "%ymm1", "%ymm2", "%ymm3", "cc", "memory");
+
+#elif defined(__aarch64__)
+
+#define STREAM_KERNELS_SUPPORTED 1
+#define STREAM_KERNELS_ISA "armv8"
+#define STREAM_KERNELS_RUNNABLE() 1
+#define STREAM_STORE "stp"
+#define STREAM_NT_STORE "stnp"
+#define STREAM_FENCE() asm volatile("dmb ish\n\t" ::: "memory");
+
+#define STREAM_READ_KERNEL(src, len)                            \
+  asm volatile("1:\n\t"                                         \
+               "ldp q0, q1, [%[s]]\n\t"                         \
+               "ldp q2, q3, [%[s], #32]\n\t"                    \
+               "ldp q4, q5, [%[s], #64]\n\t"                    \
+               "ldp q6, q7, [%[s], #96]\n\t"                    \
+               "add %[s], %[s], #128\n\t"                       \
+               "subs %[n], %[n], #128\n\t"                      \
+               "b.ne 1b\n\t"                                    \
+               : [s]"+r"(src), [n]"+r"(len)                     \
+               :: "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", \
+                  "cc", "memory");
+
+#define STREAM_WRITE_KERNEL(ST, dst, len)                       \
+  asm volatile("movi v0.16b, #0\n\t"                            \
+               "movi v1.16b, #0\n\t"                            \
+               "1:\n\t"                                         \
+               ST " q0, q1, [%[d]]\n\t"                         \
+               ST " q0, q1, [%[d], #32]\n\t"                    \
+               ST " q0, q1, [%[d], #64]\n\t"                    \
+               ST " q0, q1, [%[d], #96]\n\t"                    \
+               "add %[d], %[d], #128\n\t"                       \
+               "subs %[n], %[n], #128\n\t"                      \
+               "b.ne 1b\n\t"                                    \
+               : [d]"+r"(dst), [n]"+r"(len)                     \
+               :: "v0", "v1", "cc", "memory");
+
+#define STREAM_COPY_KERNEL(ST, src, dst, len)                   \
+  asm volatile("1:\n\t"                                         \
+               "ldp q0, q1, [%[s]]\n\t"                         \
+               "ldp q2, q3, [%[s], #32]\n\t"                    \
+               "ldp q4, q5, [%[s], #64]\n\t"                    \
+               "ldp q6, q7, [%[s], #96]\n\t"                    \
+               ST " q0, q1, [%[d]]\n\t"                         \
+               ST " q2, q3, [%[d], #32]\n\t"                    \
+               ST " q4, q5, [%[d], #64]\n\t"                    \
+               ST " q6, q7, [%[d], #96]\n\t"                    \
+               "add %[s], %[s], #128\n\t"                       \
+               "add %[d], %[d], #128\n\t"                       \
+               "subs %[n], %[n], #128\n\t"                      \
+               "b.ne 1b\n\t"                                    \
+               : [s]"+r"(src), [d]"+r"(dst), [n]"+r"(len)       \
+               :: "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", \
+                  "cc", "memory");
+
+#define STREAM_TRIAD_KERNEL(ST, src1, src2, dst, len)           \
+  asm volatile("1:\n\t"                                         \
+               "ldp q0, q1, [%[a]]\n\t"                         \
+               "ldp q2, q3, [%[a], #32]\n\t"                    \
+               "ldp q4, q5, [%[b]]\n\t"                         \
+               "ldp q6, q7, [%[b], #32]\n\t"                    \
+               "add v0.2d, v0.2d, v4.2d\n\t"                    \
+               "add v1.2d, v1.2d, v5.2d\n\t"                    \
+               "add v2.2d, v2.2d, v6.2d\n\t"                    \
+               "add v3.2d, v3.2d, v7.2d\n\t"                    \
+               ST " q0, q1, [%[d]]\n\t"                         \
+               ST " q2, q3, [%[d], #32]\n\t"                    \
+               "ldp q0, q1, [%[a], #64]\n\t"                    \
+               "ldp q2, q3, [%[a], #96]\n\t"                    \
+               "ldp q4, q5, [%[b], #64]\n\t"                    \
+               "ldp q6, q7, [%[b], #96]\n\t"                    \
+               "add v0.2d, v0.2d, v4.2d\n\t"                    \
+               "add v1.2d, v1.2d, v5.2d\n\t"                    \
+               "add v2.2d, v2.2d, v6.2d\n\t"                    \
+               "add v3.2d, v3.2d, v7.2d\n\t"                    \
+               ST " q0, q1, [%[d], #64]\n\t"                    \
+               ST " q2, q3, [%[d], #96]\n\t"                    \
+               "add %[a], %[a], #128\n\t"                       \
+               "add %[b], %[b], #128\n\t"                       \
+               "add %[d], %[d], #128\n\t"                       \
+               "subs %[n], %[n], #128\n\t"                      \
+               "b.ne 1b\n\t"                                    \
+               : [a]"+r"(src1), [b]"+r"(src2), [d]"+r"(dst), [n]"+r"(len) \
+               :: "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", \
+                  "cc", "memory");
+
+#define STREAM_UPDATE_KERNEL(ST, ptr, len)                      \
+  asm volatile("1:\n\t"                                         \
+               "ldp q0, q1, [%[p]]\n\t"                         \
+               "ldp q2, q3, [%[p], #32]\n\t"                    \
+               "ldp q4, q5, [%[p], #64]\n\t"                    \
+               "ldp q6, q7, [%[p], #96]\n\t"                    \
+               "add v0.2d, v0.2d, v0.2d\n\t"                    \
+               "add v1.2d, v1.2d, v1.2d\n\t"                    \
+               "add v2.2d, v2.2d, v2.2d\n\t"                    \
+               "add v3.2d, v3.2d, v3.2d\n\t"                    \
+               ST " q0, q1, [%[p]]\n\t"                         \
+               ST " q2, q3, [%[p], #32]\n\t"                    \
+               ST " q4, q5, [%[p], #64]\n\t"                    \
+               ST " q6, q7, [%[p], #96]\n\t"                    \
+               "add %[p], %[p], #128\n\t"                       \
+               "subs %[n], %[n], #128\n\t"                      \
+               "b.ne 1b\n\t"                                    \
+               : [p]"+r"(ptr), [n]"+r"(len)                     \
+               :: "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", \
+                  "cc", "memory");
+
+#endif
+
+#define MIN_LOG_STREAM_BYTES 20  // 1MB
+#define MAX_LOG_STREAM_BYTES 32  // 4GB
+
+// Buffers go to this NUMA node. Any node the machine doesn't have (e.g. -1)
+// means local: first touch by the thread that uses them.
+#define NODE_LOCAL -1
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MEMBW_H_
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "multicore.h"
+#include "third_party/platform_benchmarks/result.h"
+
+int parse_cpu_list(const char* str, struct CpuList* list) {
+  const char* p = str;
+  list->count = 0;
+
+  while (*p != '\0' && *p != '\n') {
+    char* endptr;
+    long first = strtol(p, &endptr, 10);
+    if (endptr == p || first < 0) return 0;
+    long last = first;
+    p = endptr;
+    if (*p == '-') {
+      last = strtol(p + 1, &endptr, 10);
+      if (endptr == p + 1 || last < first) return 0;
+      p = endptr;
+    }
+    long cpu;
+    for (cpu = first; cpu <= last; cpu++) {
+      if (list->count == MAX_CPUS || cpu >= CPU_SETSIZE) return 0;
+      list->cpus[list->count++] = cpu;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0' && *p != '\n') {
+      return 0;
+    }
+  }
+  return list->count;
+}
+
+int first_n_cpus(const int n, struct CpuList* list) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    perror("sched_getaffinity");
+    return 0;
+  }
+
+  int cpu;
+  list->count = 0;
+  for (cpu = 0; cpu < CPU_SETSIZE && list->count < n; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      list->cpus[list->count++] = cpu;
+    }
+  }
+  return list->count == n ? n : 0;
+}
+
+static struct CpuList given_cpus;
+
+void set_test_cpus(const struct CpuList* list) {
+  given_cpus = *list;
+}
+
+int test_cpus(const int n, struct CpuList* list) {
+  int k;
+  if (given_cpus.count == 0) {
+    return first_n_cpus(n, list);
+  }
+  list->count = 0;
+  for (k = 0; k < given_cpus.count && k < n; k++) {
+    list->cpus[list->count++] = given_cpus.cpus[k];
+  }
+  return list->count == n ? n : 0;
+}
+
+int smt_pair(const int cpu, struct CpuList* list) {
+  char path[128];
+  char siblings[256];
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return 0;
+  }
+  char* line = fgets(siblings, sizeof(siblings), f);
+  fclose(f);
+
+  struct CpuList* sibling_list = (struct CpuList*)malloc(sizeof(struct CpuList));
+  int k;
+  int sibling = -1;
+  if (line != NULL && parse_cpu_list(siblings, sibling_list)) {
+    for (k = 0; k < sibling_list->count; k++) {
+      if (sibling_list->cpus[k] != cpu) {
+        sibling = sibling_list->cpus[k];
+        break;
+      }
+    }
+  }
+  free(sibling_list);
+
+  if (sibling < 0) {
+    return 0;
+  }
+  list->count = 2;
+  list->cpus[0] = cpu;
+  list->cpus[1] = sibling;
+  return 2;
+}
+
+int pin_to_cpu(const int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+struct Worker {
+  int cpu;
+  pthread_barrier_t* barrier;
+  struct Result (*function)(void*);
+  void* arg;
+  struct Result* result;
+};
+
+// The barrier of the run_on_cpus call this thread works for, if any.
+static __thread pthread_barrier_t* cpus_barrier;
+
+void sync_cpus(void) {
+  if (cpus_barrier != NULL) pthread_barrier_wait(cpus_barrier);
+}
+
+static void* worker_main(void* p) {
+  struct Worker* w = (struct Worker*)p;
+  cpus_barrier = w->barrier;
+  if (pin_to_cpu(w->cpu) != 0) {
+    fprintf(stderr, "Unable to bind thread to cpu %d\n", w->cpu);
+    exit(1);
+  }
+  // Everybody is pinned and has faulted in its stack before anybody starts
+  // the clock.
+  pthread_barrier_wait(w->barrier);
+  *w->result = w->function(w->arg);
+  return NULL;
+}
+
+void run_on_cpus(const struct CpuList* list,
+                 struct Result (*function)(void*),
+                 void* arg,
+                 struct Result* results) {
+  pthread_barrier_t barrier;
+  pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * list->count);
+  struct Worker* workers =
+      (struct Worker*)malloc(sizeof(struct Worker) * list->count);
+
+  pthread_barrier_init(&barrier, NULL, list->count);
+
+  int k;
+  for (k = 0; k < list->count; k++) {
+    workers[k].cpu = list->cpus[k];
+    workers[k].barrier = &barrier;
+    workers[k].function = function;
+    workers[k].arg = arg;
+    workers[k].result = &results[k];
+    if (pthread_create(&threads[k], NULL, worker_main, &workers[k]) != 0) {
+      perror("Unable to create worker thread\n");
+      exit(1);
+    }
+  }
+  for (k = 0; k < list->count; k++) {
+    pthread_join(threads[k], NULL);
+  }
+
+  pthread_barrier_destroy(&barrier);
+  free(workers);
+  free(threads);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MULTICORE_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MULTICORE_H_
+
+#include "third_party/platform_benchmarks/result.h"
+
+#define MAX_CPUS 1024
+
+struct CpuList {
+  int count;
+  int cpus[MAX_CPUS];
+};
+
+// Parses a linux style cpu list (eg: "0-3,8,10-11").
+// Returns number of cpus parsed, 0 if the list is malformed.
+int parse_cpu_list(const char* str, struct CpuList* list);
+
+// First n cpus this process is allowed to run on.
+// Returns n, or 0 if there are fewer than n cpus available.
+int first_n_cpus(const int n, struct CpuList* list);
+
+// Tests that pin threads of their own run them on the list given here (the
+// driver's --threads, --cpus or --smt_pair) instead of on each cpu in it.
+void set_test_cpus(const struct CpuList* list);
+
+// First n cpus of the set_test_cpus() list, or first_n_cpus(n) when it is
+// empty. Returns n, or 0 if there are fewer than n cpus available, in which
+// case list still holds all of them.
+int test_cpus(const int n, struct CpuList* list);
+
+// cpu followed by its first hyperthread sibling, as reported by sysfs.
+// Returns 2, or 0 if cpu has no SMT sibling.
+int smt_pair(const int cpu, struct CpuList* list);
+
+// Binds the calling thread to cpu. Returns 0 on success.
+int pin_to_cpu(const int cpu);
+
+// Runs function(arg) on one thread pinned to each cpu in list. All threads
+// are released from a common barrier so that the timed regions overlap.
+// results[k] holds the result from list->cpus[k].
+void run_on_cpus(const struct CpuList* list,
+                 struct Result (*function)(void*),
+                 void* arg,
+                 struct Result* results);
+
+// Within function under run_on_cpus, waits for all of its threads to get
+// here, so that repeated timed regions overlap too. Every thread must call it
+// the same number of times. Does nothing on other threads.
+void sync_cpus(void);
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_MULTICORE_H_
@@ -0,0 +1,514 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <sys/prctl.h>
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#ifndef PR_SVE_SET_VL
+#define PR_SVE_SET_VL 50
+#define PR_SVE_GET_VL 51
+#endif
+#define SVE_VL_LEN_MASK 0xffff
+#endif
+
+#include "alu.h"
+#include "simd.h"
+#include "third_party/platform_benchmarks/result.h"
+#include "third_party/platform_benchmarks/util.h"
+
+// Instructions per kernel call, for each kind of kernel.
+#define LATENCY_OPS 1024         // x1k(op)
+#define THROUGHPUT_OPS 768       // x64(CHAINS12)
+#define MEM_LATENCY_OPS 64       // x64(gather or masked load + chain)
+#define GATHER_THROUGHPUT_OPS 128  // x16(CHAINS8)
+
+// Calibrate calls until the kernel runs this long, then time ~TARGET_NSEC.
+#define CALIBRATE_NSEC 10000000
+#define TARGET_NSEC 250000000
+
+// License drop timeline.
+#define LICENSE_WARMUP_NSEC 200000000
+#define LICENSE_PHASE_NSEC 200000000
+#define LICENSE_AFTER_NSEC 20000000
+#define LICENSE_HEAVY_CALLS 32
+#define LICENSE_BUCKET_NSEC 1000000
+#define LICENSE_RECOVERED 0.97
+
+#define SIMD_MAX_LANES 64  // 2048-bit SVE.
+
+// Gathers index simd_table with simd_index: lane l loads simd_table[16 * l],
+// one cacheline per lane, and gets back 16 * l, so a gather's result can be
+// its next index. Masked loads read simd_zero, so that a loaded lane can be
+// added to the address for the next one.
+static uint32_t simd_table[SIMD_MAX_LANES * 16] __attribute__((aligned(64)));
+static uint32_t simd_scratch[SIMD_MAX_LANES * 16] __attribute__((aligned(64)));
+static uint32_t simd_index[SIMD_MAX_LANES] __attribute__((aligned(64)));
+static uint32_t simd_mask[SIMD_MAX_LANES] __attribute__((aligned(64)));
+static char simd_zero[4096] __attribute__((aligned(64)));
+
+struct SimdKernels {
+  void (*latency)(uint64_t calls);
+  void (*throughput)(uint64_t calls);
+};
+
+#define SIMD_OPERANDS                                      \
+  : [p]"+r"(p)                                             \
+  : [base]"r"(simd_table), [scratch]"r"(simd_scratch),     \
+    [zero]"r"(simd_zero), [idx]"r"(simd_index),            \
+    [mask]"r"(simd_mask)                                   \
+  : SIMD_CLOBBERS, "cc", "memory"
+
+#define SIMD_KERNEL(name, setup, body)                     \
+  static SIMD_TARGET void name(uint64_t calls) {           \
+    char* p = simd_zero;                                   \
+    for (; calls > 0; calls--) {                           \
+      asm volatile(setup body SIMD_OPERANDS);              \
+    }                                                      \
+  }
+
+#define ARITH_KERNELS(name, W, R, OP)                      \
+  SIMD_KERNEL(name##_latency_##W, ZERO_REGS, x1k(OP(R, 0)))    \
+  SIMD_KERNEL(name##_throughput_##W, ZERO_REGS, x64(CHAINS12(OP, R)))
+
+#if defined(__x86_64__)
+
+#define X86_ARITH_KERNELS(W, R, PERMUTE)                   \
+  ARITH_KERNELS(int_add, W, R, INT_ADD_OP)                 \
+  ARITH_KERNELS(int_mul, W, R, INT_MUL_OP)                 \
+  ARITH_KERNELS(fp_add, W, R, FP_ADD_OP)                   \
+  ARITH_KERNELS(fp_mul, W, R, FP_MUL_OP)                   \
+  ARITH_KERNELS(fma, W, R, FMA_OP)                         \
+  ARITH_KERNELS(shuffle, W, R, SHUFFLE_OP)                 \
+  ARITH_KERNELS(permute, W, R, PERMUTE)
+
+#define X86_MEM_KERNELS(W, R, ISA, MASK_SETUP)             \
+  SIMD_KERNEL(gather_latency_##W,                          \
+              ZERO_REGS LOAD_INDEX_##ISA(R),               \
+              x64(GATHER_##ISA##_LATENCY(R)))              \
+  SIMD_KERNEL(gather_throughput_##W,                       \
+              ZERO_REGS LOAD_INDEX_##ISA(R),               \
+              x16(CHAINS8(GATHER_##ISA##_OP, R)))          \
+  SIMD_KERNEL(scatter_throughput_##W,                      \
+              ZERO_REGS LOAD_INDEX_AVX512(R),              \
+              x16(CHAINS8(SCATTER_OP, R)))                 \
+  SIMD_KERNEL(masked_load_latency_##W,                     \
+              ZERO_REGS MASK_SETUP,                        \
+              x64(MASKED_LOAD_##ISA##_LATENCY(R)))         \
+  SIMD_KERNEL(masked_load_throughput_##W,                  \
+              ZERO_REGS MASK_SETUP,                        \
+              x64(CHAINS12(MASKED_LOAD_##ISA##_OP, R)))    \
+  SIMD_KERNEL(masked_store_throughput_##W,                 \
+              ZERO_REGS MASK_SETUP,                        \
+              x64(CHAINS12(MASKED_STORE_##ISA##_OP, R)))
+
+X86_ARITH_KERNELS(128, "xmm", PERMUTE128_OP)
+X86_ARITH_KERNELS(256, "ymm", PERMUTE_OP)
+X86_ARITH_KERNELS(512, "zmm", PERMUTE_OP)
+X86_MEM_KERNELS(128, "xmm", AVX2, LOAD_MASK_AVX2("xmm"))
+X86_MEM_KERNELS(256, "ymm", AVX2, LOAD_MASK_AVX2("ymm"))
+X86_MEM_KERNELS(512, "zmm", AVX512, LOAD_MASK_AVX512)
+
+#define X86_KERNEL_TABLE(W)                                \
+  {                                                        \
+    {int_add_latency_##W, int_add_throughput_##W},         \
+    {int_mul_latency_##W, int_mul_throughput_##W},         \
+    {fp_add_latency_##W, fp_add_throughput_##W},           \
+    {fp_mul_latency_##W, fp_mul_throughput_##W},           \
+    {fma_latency_##W, fma_throughput_##W},                 \
+    {shuffle_latency_##W, shuffle_throughput_##W},         \
+    {permute_latency_##W, permute_throughput_##W},         \
+    {gather_latency_##W, gather_throughput_##W},           \
+    {NULL, scatter_throughput_##W},                        \
+    {masked_load_latency_##W, masked_load_throughput_##W}, \
+    {NULL, masked_store_throughput_##W},                   \
+  }
+
+static const struct SimdKernels kernels_128[NUM_SIMD_OPS] =
+    X86_KERNEL_TABLE(128);
+static const struct SimdKernels kernels_256[NUM_SIMD_OPS] =
+    X86_KERNEL_TABLE(256);
+static const struct SimdKernels kernels_512[NUM_SIMD_OPS] =
+    X86_KERNEL_TABLE(512);
+
+// The CPU feature an op needs at width, NULL if we have it.
+static const char* missing_feature(const int op, const int width) {
+  __builtin_cpu_init();
+  if (width == 512) {
+    if (!__builtin_cpu_supports("avx512f")) return "avx512f";
+    if (op == SIMD_SHUFFLE && !__builtin_cpu_supports("avx512bw")) {
+      return "avx512bw";
+    }
+    return NULL;
+  }
+  if (!__builtin_cpu_supports("avx2")) return "avx2";
+  if (op == SIMD_FMA && !__builtin_cpu_supports("fma")) return "fma";
+  if (op == SIMD_SCATTER && !(__builtin_cpu_supports("avx512f") &&
+                              __builtin_cpu_supports("avx512vl"))) {
+    return "avx512vl";
+  }
+  return NULL;
+}
+
+static const struct SimdKernels* lookup(const int op, const int width,
+                                        const char** missing) {
+  *missing = missing_feature(op, width);
+  if (*missing != NULL) return NULL;
+  switch (width) {
+    case 128:
+      return &kernels_128[op];
+    case 256:
+      return &kernels_256[op];
+    default:
+      return &kernels_512[op];
+  }
+}
+
+// Vector length is fixed on x86.
+static void restore_sve_width() {}
+
+#elif defined(__aarch64__)
+
+#define SVE_KERNELS(name, OP)                              \
+  SIMD_KERNEL(name##_latency_sve, ZERO_REGS SVE_SETUP,     \
+              x1k(OP(, 0)))                                \
+  SIMD_KERNEL(name##_throughput_sve, ZERO_REGS SVE_SETUP,  \
+              x64(CHAINS12(OP, )))
+
+ARITH_KERNELS(int_add, neon, , NEON_INT_ADD_OP)
+ARITH_KERNELS(int_mul, neon, , NEON_INT_MUL_OP)
+ARITH_KERNELS(fp_add, neon, , NEON_FP_ADD_OP)
+ARITH_KERNELS(fp_mul, neon, , NEON_FP_MUL_OP)
+ARITH_KERNELS(fma, neon, , NEON_FMA_OP)
+ARITH_KERNELS(shuffle, neon, , NEON_SHUFFLE_OP)
+ARITH_KERNELS(permute, neon, , NEON_PERMUTE_OP)
+
+SVE_KERNELS(int_add, SVE_INT_ADD_OP)
+SVE_KERNELS(int_mul, SVE_INT_MUL_OP)
+SVE_KERNELS(fp_add, SVE_FP_ADD_OP)
+SVE_KERNELS(fp_mul, SVE_FP_MUL_OP)
+SVE_KERNELS(fma, SVE_FMA_OP)
+SVE_KERNELS(shuffle, SVE_SHUFFLE_OP)
+SVE_KERNELS(permute, SVE_PERMUTE_OP)
+SIMD_KERNEL(gather_latency_sve, ZERO_REGS SVE_SETUP LOAD_INDEX_SVE,
+            x64(SVE_GATHER_LATENCY()))
+SIMD_KERNEL(gather_throughput_sve, ZERO_REGS SVE_SETUP LOAD_INDEX_SVE,
+            x16(CHAINS8(SVE_GATHER_OP, )))
+SIMD_KERNEL(scatter_throughput_sve, ZERO_REGS SVE_SETUP LOAD_INDEX_SVE,
+            x16(CHAINS8(SVE_SCATTER_OP, )))
+SIMD_KERNEL(masked_load_latency_sve, ZERO_REGS SVE_SETUP,
+            x64(SVE_MASKED_LOAD_LATENCY()))
+SIMD_KERNEL(masked_load_throughput_sve, ZERO_REGS SVE_SETUP,
+            x64(CHAINS12(SVE_MASKED_LOAD_OP, )))
+SIMD_KERNEL(masked_store_throughput_sve, ZERO_REGS SVE_SETUP,
+            x64(CHAINS12(SVE_MASKED_STORE_OP, )))
+
+// NEON has no gathers, scatters or masked moves.
+static const struct SimdKernels kernels_neon[NUM_SIMD_OPS] = {
+  {int_add_latency_neon, int_add_throughput_neon},
+  {int_mul_latency_neon, int_mul_throughput_neon},
+  {fp_add_latency_neon, fp_add_throughput_neon},
+  {fp_mul_latency_neon, fp_mul_throughput_neon},
+  {fma_latency_neon, fma_throughput_neon},
+  {shuffle_latency_neon, shuffle_throughput_neon},
+  {permute_latency_neon, permute_throughput_neon},
+};
+
+static const struct SimdKernels kernels_sve[NUM_SIMD_OPS] = {
+  {int_add_latency_sve, int_add_throughput_sve},
+  {int_mul_latency_sve, int_mul_throughput_sve},
+  {fp_add_latency_sve, fp_add_throughput_sve},
+  {fp_mul_latency_sve, fp_mul_throughput_sve},
+  {fma_latency_sve, fma_throughput_sve},
+  {shuffle_latency_sve, shuffle_throughput_sve},
+  {permute_latency_sve, permute_throughput_sve},
+  {gather_latency_sve, gather_throughput_sve},
+  {NULL, scatter_throughput_sve},
+  {masked_load_latency_sve, masked_load_throughput_sve},
+  {NULL, masked_store_throughput_sve},
+};
+
+// PR_SVE_GET_VL before the first set_sve_width, -1 if we haven't changed it.
+static int saved_sve_vl = -1;
+
+// Sets the SVE vector length to width bits. Returns 0 if we can't.
+static int set_sve_width(const int width) {
+  if (!(getauxval(AT_HWCAP) & HWCAP_SVE)) return 0;
+  if (saved_sve_vl < 0) saved_sve_vl = prctl(PR_SVE_GET_VL);
+  const int vl = prctl(PR_SVE_SET_VL, width / 8);
+  return vl >= 0 && (vl & SVE_VL_LEN_MASK) == width / 8;
+}
+
+// Puts back the vector length (and flags) set_sve_width found, so that the
+// rest of the process runs at the vector length it started with.
+static void restore_sve_width() {
+  if (saved_sve_vl < 0) return;
+  prctl(PR_SVE_SET_VL, saved_sve_vl);
+  saved_sve_vl = -1;
+}
+
+// 128-bit arithmetic runs on NEON, everything else needs SVE at width.
+static const struct SimdKernels* lookup(const int op, const int width,
+                                        const char** missing) {
+  *missing = NULL;
+  if (width == 128 && kernels_neon[op].latency != NULL) {
+    return &kernels_neon[op];
+  }
+  if (set_sve_width(width)) return &kernels_sve[op];
+  *missing = "sve";
+  return NULL;
+}
+
+#else
+
+static const struct SimdKernels* lookup(const int op, const int width,
+                                        const char** missing) {
+  *missing = "simd";
+  return NULL;
+}
+
+static void restore_sve_width() {}
+
+#endif
+
+static void init_simd_buffers() {
+  int i;
+  for (i = 0; i < SIMD_MAX_LANES * 16; i++) {
+    simd_table[i] = i & ~15;
+  }
+  for (i = 0; i < SIMD_MAX_LANES; i++) {
+    simd_index[i] = 16 * i;
+    simd_mask[i] = (i % 2 == 0) ? 0xffffffff : 0;
+  }
+}
+
+static const char* simd_op_string(const int op) {
+  static const char* names[NUM_SIMD_OPS] = {
+    "int_add", "int_mul", "fp_add", "fp_mul", "fma", "shuffle", "permute",
+    "gather", "scatter", "masked_load", "masked_store",
+  };
+  return names[op];
+}
+
+// Billions of ops per second running kernel for ~TARGET_NSEC.
+static double kernel_gops(void (*kernel)(uint64_t), const int ops) {
+  uint64_t calls = 16;
+  uint64_t t;
+
+  kernel(calls);  // Wake up the vector units.
+  while (1) {
+    t = now_nsec();
+    kernel(calls);
+    t = now_nsec() - t;
+    if (t >= CALIBRATE_NSEC) break;
+    calls *= 2;
+  }
+  calls = calls * TARGET_NSEC / t;
+  timed_region_begin();
+  t = now_nsec();
+  kernel(calls);
+  t = now_nsec() - t;
+  timed_region_end();
+  return (double)calls * ops / t;
+}
+
+static struct Result simd_test(const char* name, const int op,
+                               const int width, const int latency) {
+  struct Result result;
+  const char* missing;
+  result.metric = 0;
+  result.resulthash = 0;
+  strcpy(result.metricname, "GOPS");
+  assert(op >= 0 && op < NUM_SIMD_OPS);
+  assert(width == 128 || width == 256 || width == 512);
+
+  const struct SimdKernels* k = lookup(op, width, &missing);
+  if (k == NULL) {
+    restore_sve_width();
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s(%s, width=%d) NOT APPLICABLE on Current Platform (no %s)",
+             name, simd_op_string(op), width, missing);
+    return result;
+  }
+  void (*kernel)(uint64_t) = latency ? k->latency : k->throughput;
+  if (kernel == NULL) {
+    restore_sve_width();
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s(%s, width=%d) NOT APPLICABLE (stores have no result)",
+             name, simd_op_string(op), width);
+    return result;
+  }
+
+  int ops;
+  switch (op) {
+    case SIMD_GATHER:
+    case SIMD_SCATTER:
+      ops = latency ? MEM_LATENCY_OPS : GATHER_THROUGHPUT_OPS;
+      break;
+    case SIMD_MASKED_LOAD:
+    case SIMD_MASKED_STORE:
+      ops = latency ? MEM_LATENCY_OPS : THROUGHPUT_OPS;
+      break;
+    default:
+      ops = latency ? LATENCY_OPS : THROUGHPUT_OPS;
+  }
+
+  init_simd_buffers();
+  result.metric = kernel_gops(kernel, ops);
+  result.resulthash = simd_scratch[0];
+  restore_sve_width();
+  snprintf(result.function, FN_NAME_LENGTH, "%s(%s, width=%d)", name,
+           simd_op_string(op), width);
+  return result;
+}
+
+struct Result simd_latency(const unsigned op, const unsigned width) {
+  return simd_test(__FUNCTION__, op, width, 1);
+}
+
+struct Result simd_throughput(const unsigned op, const unsigned width) {
+  return simd_test(__FUNCTION__, op, width, 0);
+}
+
+#if defined(__x86_64__)
+
+// Dependent register adds run at one per cycle, so this is the core clock.
+static double scalar_ghz() { return add_chain_ghz(8); }
+
+// Mean scalar GHz over a phase of nsec, running heavy (if not NULL) between
+// samples. Only the second half of the phase counts, so that we measure
+// after any frequency transition has settled.
+static double phase_ghz(void (*heavy)(uint64_t), const uint64_t nsec) {
+  const uint64_t start = now_nsec();
+  double sum = 0;
+  uint64_t n = 0;
+  uint64_t t;
+
+  while ((t = now_nsec()) - start < nsec) {
+    if (heavy != NULL) heavy(LICENSE_HEAVY_CALLS);
+    const double ghz = scalar_ghz();
+    if (t - start >= nsec / 2) {
+      sum += ghz;
+      n++;
+    }
+  }
+  // No sample in the second half (eg: one heavy call outlasted the phase):
+  // report 0, which the callers reject as implausible.
+  if (n == 0) return 0;
+  return sum / n;
+}
+
+#endif
+
+struct Result simd_license_drop(const unsigned width) {
+  struct Result result;
+  result.metric = 0;
+  result.resulthash = 0;
+  strcpy(result.metricname, "pct_slower");
+  assert(width == 128 || width == 256 || width == 512);
+
+#if defined(__x86_64__)
+  const char* missing;
+  const struct SimdKernels* k = lookup(SIMD_FMA, width, &missing);
+  if (k == NULL) {
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s(width=%u) NOT APPLICABLE on Current Platform (no %s)",
+             __FUNCTION__, width, missing);
+    return result;
+  }
+  init_simd_buffers();
+
+  // Before: scalar only, long enough to reach a steady (turbo) clock.
+  phase_ghz(NULL, LICENSE_WARMUP_NSEC);
+  const double before = phase_ghz(NULL, LICENSE_PHASE_NSEC);
+  // During: scalar samples between bursts of width-wide FMAs.
+  const double during = phase_ghz(k->throughput, LICENSE_PHASE_NSEC);
+
+  if (before < MIN_PLAUSIBLE_GHZ || before > MAX_PLAUSIBLE_GHZ ||
+      during < MIN_PLAUSIBLE_GHZ || during > MAX_PLAUSIBLE_GHZ) {
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s(width=%u) NOT APPLICABLE (implausible clock %.3f/%.3f GHz)",
+             __FUNCTION__, width, before, during);
+    return result;
+  }
+
+  // After: how long the clock takes to come back.
+  const uint64_t end = now_nsec();
+  const int buckets = LICENSE_AFTER_NSEC / LICENSE_BUCKET_NSEC;
+  double sum[LICENSE_AFTER_NSEC / LICENSE_BUCKET_NSEC];
+  int count[LICENSE_AFTER_NSEC / LICENSE_BUCKET_NSEC];
+  int64_t recovered_usec = -1;
+  uint64_t t;
+  int b;
+
+  memset(sum, 0, sizeof(sum));
+  memset(count, 0, sizeof(count));
+  while ((t = now_nsec() - end) < LICENSE_AFTER_NSEC) {
+    const double ghz = scalar_ghz();
+    sum[t / LICENSE_BUCKET_NSEC] += ghz;
+    count[t / LICENSE_BUCKET_NSEC]++;
+    if (recovered_usec < 0 && ghz >= before * LICENSE_RECOVERED) {
+      recovered_usec = t / 1000;
+    }
+  }
+
+  strcpy(result.metricname, "GHz");
+  result.metric = before;
+  snprintf(result.function, FN_NAME_LENGTH, "%s(width=%u, before)",
+           __FUNCTION__, width);
+  emit_point(&result);
+  result.metric = during;
+  snprintf(result.function, FN_NAME_LENGTH, "%s(width=%u, during)",
+           __FUNCTION__, width);
+  emit_point(&result);
+  for (b = 0; b < buckets; b++) {
+    result.metric = count[b] ? sum[b] / count[b] : 0;
+    snprintf(result.function, FN_NAME_LENGTH,
+             "%s(width=%u, after %d-%d usec)", __FUNCTION__, width,
+             b * (LICENSE_BUCKET_NSEC / 1000),
+             (b + 1) * (LICENSE_BUCKET_NSEC / 1000));
+    emit_point(&result);
+  }
+  // -1 if the clock didn't come back within LICENSE_AFTER_NSEC.
+  strcpy(result.metricname, "usec");
+  result.metric = recovered_usec;
+  snprintf(result.function, FN_NAME_LENGTH, "%s(width=%u, recovery)",
+           __FUNCTION__, width);
+  emit_point(&result);
+
+  strcpy(result.metricname, "pct_slower");
+
+  // Noise can make the heavy phase come out marginally faster; that's no drop.
+  result.metric = during < before ? 100 * (1 - during / before) : 0;
+  result.resulthash = (uint64_t)(before * 1000);
+  snprintf(result.function, FN_NAME_LENGTH, "%s(width=%u)", __FUNCTION__,
+           width);
+#else
+  // No frequency licenses to detect on other ISAs.
+  snprintf(result.function, FN_NAME_LENGTH,
+           "%s(width=%u) NOT APPLICABLE on Current Platform", __FUNCTION__,
+           width);
+#endif
+  return result;
+}
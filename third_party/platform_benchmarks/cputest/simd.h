@@ -0,0 +1,198 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SIMD_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SIMD_H_
+
+#include "third_party/platform_benchmarks/util.h"
+
+// Operations measured by simd_latency and simd_throughput, on 32-bit lanes.
+#define SIMD_INT_ADD 0
+#define SIMD_INT_MUL 1
+#define SIMD_FP_ADD 2
+#define SIMD_FP_MUL 3
+#define SIMD_FMA 4
+#define SIMD_SHUFFLE 5       // Byte shuffle within 128-bit lanes.
+#define SIMD_PERMUTE 6       // Dword permute across the whole vector.
+#define SIMD_GATHER 7
+#define SIMD_SCATTER 8
+#define SIMD_MASKED_LOAD 9   // Every other lane enabled.
+#define SIMD_MASKED_STORE 10
+#define NUM_SIMD_OPS 11
+
+// Op templates take a register family R and a destination register d.
+// Latency kernels chain d=0 on itself, throughput kernels run 12 independent
+// chains (d=0..11, enough to cover latency x throughput of a 10 cycle op on
+// one port) or, for gathers and scatters, 8 (d=1..8, 0 holds the indices).
+// 12-13 are sources, 14-15 hold masks.
+
+#define CHAINS12(OP, R)                                    \
+  OP(R, 0) OP(R, 1) OP(R, 2) OP(R, 3) OP(R, 4) OP(R, 5)    \
+  OP(R, 6) OP(R, 7) OP(R, 8) OP(R, 9) OP(R, 10) OP(R, 11)
+#define CHAINS8(OP, R)                                     \
+  OP(R, 1) OP(R, 2) OP(R, 3) OP(R, 4) OP(R, 5) OP(R, 6) OP(R, 7) OP(R, 8)
+
+#if defined(__x86_64__)
+
+#define VR(R, n) "%%" R #n
+
+#define ZERO_REGS                                  \
+  "vpxor %%xmm0, %%xmm0, %%xmm0\n\t"               \
+  "vpxor %%xmm1, %%xmm1, %%xmm1\n\t"               \
+  "vpxor %%xmm2, %%xmm2, %%xmm2\n\t"               \
+  "vpxor %%xmm3, %%xmm3, %%xmm3\n\t"               \
+  "vpxor %%xmm4, %%xmm4, %%xmm4\n\t"               \
+  "vpxor %%xmm5, %%xmm5, %%xmm5\n\t"               \
+  "vpxor %%xmm6, %%xmm6, %%xmm6\n\t"               \
+  "vpxor %%xmm7, %%xmm7, %%xmm7\n\t"               \
+  "vpxor %%xmm8, %%xmm8, %%xmm8\n\t"               \
+  "vpxor %%xmm9, %%xmm9, %%xmm9\n\t"               \
+  "vpxor %%xmm10, %%xmm10, %%xmm10\n\t"            \
+  "vpxor %%xmm11, %%xmm11, %%xmm11\n\t"            \
+  "vpxor %%xmm12, %%xmm12, %%xmm12\n\t"            \
+  "vpxor %%xmm13, %%xmm13, %%xmm13\n\t"
+
+#define INT_ADD_OP(R, d) \
+  "vpaddd " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+#define INT_MUL_OP(R, d) \
+  "vpmulld " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+#define FP_ADD_OP(R, d) \
+  "vaddps " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+#define FP_MUL_OP(R, d) \
+  "vmulps " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+#define FMA_OP(R, d) \
+  "vfmadd231ps " VR(R, 13) ", " VR(R, 12) ", " VR(R, d) "\n\t"
+#define SHUFFLE_OP(R, d) \
+  "vpshufb " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+// A 128-bit vector is one lane, so vpermilps is its full permute.
+#define PERMUTE128_OP(R, d) \
+  "vpermilps " VR(R, 12) ", " VR(R, d) ", " VR(R, d) "\n\t"
+#define PERMUTE_OP(R, d) \
+  "vpermd " VR(R, d) ", " VR(R, 12) ", " VR(R, d) "\n\t"
+
+// AVX2 gathers and masked moves, for 128 and 256 bits.
+#define LOAD_INDEX_AVX2(R) "vmovdqu (%[idx]), " VR(R, 0) "\n\t"
+#define LOAD_MASK_AVX2(R) "vmovdqu (%[mask]), " VR(R, 15) "\n\t"
+
+#define GATHER_AVX2_OP(R, d)                               \
+  "vpcmpeqd " VR(R, 14) ", " VR(R, 14) ", " VR(R, 14) "\n\t"   \
+  "vpgatherdd " VR(R, 14) ", (%[base], " VR(R, 0) ", 4), " VR(R, d) "\n\t"
+#define GATHER_AVX2_LATENCY(R) \
+  GATHER_AVX2_OP(R, 1) "vmovdqa " VR(R, 1) ", " VR(R, 0) "\n\t"
+
+#define MASKED_LOAD_AVX2_OP(R, d) \
+  "vpmaskmovd " #d "*64(%[zero]), " VR(R, 15) ", " VR(R, d) "\n\t"
+#define MASKED_LOAD_AVX2_LATENCY(R)                        \
+  "vpmaskmovd (%[p]), " VR(R, 15) ", " VR(R, 0) "\n\t"     \
+  "vmovq %%xmm0, %%rax\n\t"                                \
+  "add %%rax, %[p]\n\t"
+#define MASKED_STORE_AVX2_OP(R, d) \
+  "vpmaskmovd " VR(R, d) ", " VR(R, 15) ", " #d "*64(%[scratch])\n\t"
+
+// AVX-512 (EVEX) gathers, scatters and masked moves. Scatters at 128 and 256
+// bits need AVX512VL.
+#define LOAD_INDEX_AVX512(R) "vmovdqu32 (%[idx]), " VR(R, 0) "\n\t"
+#define LOAD_MASK_AVX512 "mov $0x5555, %%eax\n\t" \
+                         "kmovw %%eax, %%k2\n\t"
+
+#define GATHER_AVX512_OP(R, d)                             \
+  "kxnorw %%k0, %%k0, %%k1\n\t"                            \
+  "vpgatherdd (%[base], " VR(R, 0) ", 4), " VR(R, d) "%{%%k1%}\n\t"
+#define GATHER_AVX512_LATENCY(R) \
+  GATHER_AVX512_OP(R, 1) "vmovdqa32 " VR(R, 1) ", " VR(R, 0) "\n\t"
+
+#define SCATTER_OP(R, d)                                   \
+  "kxnorw %%k0, %%k0, %%k1\n\t"                            \
+  "vpscatterdd " VR(R, d) ", (%[scratch], " VR(R, 0) ", 4)%{%%k1%}\n\t"
+
+#define MASKED_LOAD_AVX512_OP(R, d) \
+  "vmovdqu32 " #d "*64(%[zero]), " VR(R, d) "%{%%k2%}%{z%}\n\t"
+#define MASKED_LOAD_AVX512_LATENCY(R)                      \
+  "vmovdqu32 (%[p]), " VR(R, 0) "%{%%k2%}%{z%}\n\t"        \
+  "vmovq %%xmm0, %%rax\n\t"                                \
+  "add %%rax, %[p]\n\t"
+#define MASKED_STORE_AVX512_OP(R, d) \
+  "vmovdqu32 " VR(R, d) ", " #d "*64(%[scratch])%{%%k2%}\n\t"
+
+#define SIMD_CLOBBERS                                      \
+  "%rax", "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", \
+  "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11",  \
+  "%xmm12", "%xmm13", "%xmm14", "%xmm15", "%k1", "%k2"
+
+// Lets the kernels name zmm and mask registers without building the whole
+// binary for AVX-512. The kernels only run once the features are detected.
+#define SIMD_TARGET \
+  __attribute__((target("avx2,fma,avx512f,avx512vl,avx512bw")))
+
+#elif defined(__aarch64__)
+
+// NEON is 128 bits. R is unused, but keeps the templates interchangeable.
+#define ZERO_REGS                                          \
+  "movi v0.16b, #0\n\t" "movi v1.16b, #0\n\t"              \
+  "movi v2.16b, #0\n\t" "movi v3.16b, #0\n\t"              \
+  "movi v4.16b, #0\n\t" "movi v5.16b, #0\n\t"              \
+  "movi v6.16b, #0\n\t" "movi v7.16b, #0\n\t"              \
+  "movi v8.16b, #0\n\t" "movi v9.16b, #0\n\t"              \
+  "movi v10.16b, #0\n\t" "movi v11.16b, #0\n\t"            \
+  "movi v12.16b, #0\n\t" "movi v13.16b, #0\n\t"
+
+#define NEON_INT_ADD_OP(R, d) "add v" #d ".4s, v" #d ".4s, v12.4s\n\t"
+#define NEON_INT_MUL_OP(R, d) "mul v" #d ".4s, v" #d ".4s, v12.4s\n\t"
+#define NEON_FP_ADD_OP(R, d) "fadd v" #d ".4s, v" #d ".4s, v12.4s\n\t"
+#define NEON_FP_MUL_OP(R, d) "fmul v" #d ".4s, v" #d ".4s, v12.4s\n\t"
+#define NEON_FMA_OP(R, d) "fmla v" #d ".4s, v12.4s, v13.4s\n\t"
+#define NEON_SHUFFLE_OP(R, d) "tbl v" #d ".16b, {v12.16b}, v" #d ".16b\n\t"
+#define NEON_PERMUTE_OP(R, d) "zip1 v" #d ".4s, v" #d ".4s, v12.4s\n\t"
+
+// SVE runs at the current vector length, which simd.c sets to the requested
+// width. Writing a V register zeroes the rest of the Z register, so
+// ZERO_REGS works for both. p0 is all lanes, p1 every other 32-bit lane.
+#define SVE_SETUP ".arch_extension sve\n\t" \
+                  "ptrue p0.s\n\t"          \
+                  "ptrue p1.d\n\t"
+#define LOAD_INDEX_SVE "ld1w {z0.s}, p0/z, [%[idx]]\n\t"
+
+#define SVE_INT_ADD_OP(R, d) "add z" #d ".s, z" #d ".s, z12.s\n\t"
+#define SVE_INT_MUL_OP(R, d) "mul z" #d ".s, p0/m, z" #d ".s, z12.s\n\t"
+#define SVE_FP_ADD_OP(R, d) "fadd z" #d ".s, z" #d ".s, z12.s\n\t"
+#define SVE_FP_MUL_OP(R, d) "fmul z" #d ".s, z" #d ".s, z12.s\n\t"
+#define SVE_FMA_OP(R, d) "fmla z" #d ".s, p0/m, z12.s, z13.s\n\t"
+#define SVE_SHUFFLE_OP(R, d) "tbl z" #d ".b, {z12.b}, z" #d ".b\n\t"
+#define SVE_PERMUTE_OP(R, d) "zip1 z" #d ".s, z" #d ".s, z12.s\n\t"
+
+#define SVE_GATHER_OP(R, d) \
+  "ld1w {z" #d ".s}, p0/z, [%[base], z0.s, uxtw #2]\n\t"
+#define SVE_GATHER_LATENCY(R) SVE_GATHER_OP(R, 1) "mov z0.d, z1.d\n\t"
+#define SVE_SCATTER_OP(R, d) \
+  "st1w {z" #d ".s}, p0, [%[scratch], z0.s, uxtw #2]\n\t"
+#define SVE_MASKED_LOAD_OP(R, d) "ld1w {z" #d ".s}, p1/z, [%[zero]]\n\t"
+#define SVE_MASKED_LOAD_LATENCY(R)                         \
+  "ld1w {z0.s}, p1/z, [%[p]]\n\t"                          \
+  "fmov x5, d0\n\t"                                        \
+  "add %[p], %[p], x5\n\t"
+#define SVE_MASKED_STORE_OP(R, d) "st1w {z" #d ".s}, p1, [%[scratch]]\n\t"
+
+// Predicate registers aren't clobbers GCC knows about without SVE enabled.
+// Nothing outside these asm statements uses them in a non-SVE build.
+#define SIMD_CLOBBERS                                      \
+  "x5", "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "v8",  \
+  "v9", "v10", "v11", "v12", "v13", "v14", "v15"
+
+#define SIMD_TARGET
+
+#endif
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SIMD_H_
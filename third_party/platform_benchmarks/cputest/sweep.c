@@ -0,0 +1,141 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sweep.h"
+
+// Relative amount by which metric b is worse than metric a.
+static double worse_by(const struct Sweep* s, const double a, const double b) {
+  if (a <= 0 || b <= 0) return 0;
+  return s->lower_is_better ? b / a - 1 : a / b - 1;
+}
+
+// Measures x and inserts it in order. Returns the point's index, -1 if the
+// sweep is full or measure failed.
+static int add_point(struct Sweep* s, const uint64_t x) {
+  int i;
+  if (s->count == MAX_SWEEP_POINTS) return -1;
+  const double y = s->measure(s->arg, x);
+  if (y <= 0) return -1;
+  for (i = s->count; i > 0 && s->points[i - 1].x > x; i--) {
+    s->points[i] = s->points[i - 1];
+  }
+  s->points[i].x = x;
+  s->points[i].y = y;
+  s->count++;
+  return i;
+}
+
+static void coarse_pass(struct Sweep* s) {
+  uint64_t octave, x;
+  int k;
+
+  if (s->steps_per_octave == 0) {
+    for (x = s->lo; x <= s->hi; x++) {
+      if (add_point(s, x) < 0) return;
+    }
+    return;
+  }
+  for (octave = s->lo; octave <= s->hi; octave *= 2) {
+    for (k = 0; k < s->steps_per_octave; k++) {
+      x = octave + octave * k / s->steps_per_octave;
+      if (x > s->hi || (k > 0 && x == s->points[s->count - 1].x)) break;
+      if (add_point(s, x) < 0) return;
+    }
+  }
+  if (s->count > 0 && s->points[s->count - 1].x < s->hi) {
+    add_point(s, s->hi);
+  }
+}
+
+// Bisects [a, b] for the last x within threshold / 2 of the metric at a.
+static uint64_t refine_knee(struct Sweep* s, uint64_t a, uint64_t b) {
+  const double plateau = sweep_metric(s, a);
+  while (b - a > 1 && b - a > a / SWEEP_RESOLUTION) {
+    const uint64_t m = a + (b - a) / 2;
+    const int i = add_point(s, m);
+    if (i < 0) break;
+    if (worse_by(s, plateau, s->points[i].y) <= s->threshold / 2) {
+      a = m;
+    } else {
+      b = m;
+    }
+  }
+  return a;
+}
+
+void run_sweep(struct Sweep* s) {
+  assert(s->lo <= s->hi && (s->lo > 0 || s->steps_per_octave == 0));
+  s->count = 0;
+  s->knee_count = 0;
+  coarse_pass(s);
+
+  // Knees are found on the coarse points. Refining inserts points, so walk
+  // a copy.
+  struct SweepPoint coarse[MAX_SWEEP_POINTS];
+  const int n = s->count;
+  int steep_before = 0;
+  int i;
+  memcpy(coarse, s->points, sizeof(struct SweepPoint) * n);
+  for (i = 0; i + 1 < n; i++) {
+    const int steep = worse_by(s, coarse[i].y, coarse[i + 1].y) > s->threshold;
+    if (steep && !steep_before && s->knee_count < MAX_SWEEP_KNEES) {
+      s->knees[s->knee_count++] =
+          s->refine ? refine_knee(s, coarse[i].x, coarse[i + 1].x) :
+                      coarse[i].x;
+    }
+    steep_before = steep;
+  }
+}
+
+double sweep_metric(const struct Sweep* s, const uint64_t x) {
+  int i;
+  for (i = 0; i < s->count; i++) {
+    if (s->points[i].x == x) return s->points[i].y;
+  }
+  assert(0);
+  return 0;
+}
+
+uint64_t sweep_crossover(const struct Sweep* a, const struct Sweep* b) {
+  uint64_t crossover = 0;
+  int i, j;
+  for (i = 0, j = 0; i < a->count && j < b->count;) {
+    if (a->points[i].x < b->points[j].x) {
+      i++;
+    } else if (a->points[i].x > b->points[j].x) {
+      j++;
+    } else {
+      if (worse_by(a, b->points[j].y, a->points[i].y) > 0) {
+        crossover = 0;
+      } else if (crossover == 0) {
+        crossover = a->points[i].x;
+      }
+      i++;
+      j++;
+    }
+  }
+  return crossover;
+}
+
+uint64_t round_capacity(const uint64_t x) {
+  if (x < 4) return x;
+  const uint64_t quarter = (1llu << (63 - __builtin_clzll(x))) / 4;
+  return (x + quarter - 1) / quarter * quarter;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SWEEP_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SWEEP_H_
+
+#include <stdint.h>
+
+#define MAX_SWEEP_POINTS 256
+#define MAX_SWEEP_KNEES 8
+
+// Refinement stops when a steep interval is narrower than 1/32 of its start.
+#define SWEEP_RESOLUTION 32
+
+// Default relative change between neighbouring points that counts as steep.
+#define SWEEP_THRESHOLD 0.25
+
+struct SweepPoint {
+  uint64_t x;
+  double y;
+};
+
+// Sweeps measure(arg, x) over x in [lo, hi] in one process:
+// 1. A coarse pass at steps_per_octave points per octave (x, x + x/steps,
+//    ... 2x), or at every integer if steps_per_octave is 0 (for arguments
+//    that are already log2 of a size).
+// 2. Every steep interval, one where the metric gets worse by more than
+//    threshold, that starts a drop (the interval before it isn't steep) is a
+//    knee. If refine is set the interval is bisected, looking for the last x
+//    still within threshold / 2 of the metric before the drop.
+// measure returns 0 if it can't run at x, which ends the coarse pass.
+struct Sweep {
+  double (*measure)(void* arg, const uint64_t x);
+  void* arg;
+  uint64_t lo;
+  uint64_t hi;
+  int steps_per_octave;
+  int refine;
+  int lower_is_better;  // Latencies. Can be set by measure on its first call.
+  double threshold;
+
+  // Filled in by run_sweep. points is sorted by x.
+  struct SweepPoint points[MAX_SWEEP_POINTS];
+  int count;
+  uint64_t knees[MAX_SWEEP_KNEES];  // Last x before each drop.
+  int knee_count;
+};
+
+void run_sweep(struct Sweep* s);
+
+// The metric at x, which must have been measured.
+double sweep_metric(const struct Sweep* s, const uint64_t x);
+
+// Smallest x of a from which a is at least as good as b at every point the
+// two sweeps share, 0 if there is none.
+uint64_t sweep_crossover(const struct Sweep* a, const struct Sweep* b);
+
+// Rounds a detected capacity up to a multiple of a quarter of its octave
+// (32K, 40K, 48K, 56K, 64K ...). Knees land a little under the real size.
+uint64_t round_capacity(const uint64_t x);
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_CPUTEST_SWEEP_H_
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+#include "result.h"
+
+#define CACHE_READ_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+struct CounterConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+// Indexed by enum CounterEvent.
+static const struct CounterConfig counter_configs[NUM_COUNTER_EVENTS] = {
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_ITLB)},
+};
+
+int perf_counters_open(struct PerfCounters* pc) {
+  int e;
+  int opened = 0;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_configs[e].type;
+    attr.config = counter_configs[e].config;
+    attr.disabled = 1;
+    // User mode only, works with perf_event_paranoid=2.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = (PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING);
+    pc->fd[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    pc->total[e] = 0;
+    if (pc->fd[e] >= 0) {
+      opened++;
+    }
+  }
+  pc->runs = 0;
+  return opened;
+}
+
+void perf_counters_start(struct PerfCounters* pc) {
+  int e;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    if (pc->fd[e] >= 0) {
+      ioctl(pc->fd[e], PERF_EVENT_IOC_RESET, 0);
+      ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void perf_counters_stop(struct PerfCounters* pc) {
+  int e;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    if (pc->fd[e] >= 0) {
+      ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    // value, time_enabled, time_running
+    uint64_t v[3];
+    if (pc->fd[e] < 0) continue;
+    if (read(pc->fd[e], v, sizeof(v)) != sizeof(v) || v[2] == 0) {
+      // Never got scheduled on the PMU, treat as not countable.
+      close(pc->fd[e]);
+      pc->fd[e] = -1;
+      continue;
+    }
+    pc->total[e] += (double)v[0] * v[1] / v[2];
+  }
+  pc->runs++;
+}
+
+void perf_counters_pause(struct PerfCounters* pc) {
+  int e;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    if (pc->fd[e] >= 0) {
+      ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+}
+
+void perf_counters_resume(struct PerfCounters* pc) {
+  int e;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    if (pc->fd[e] >= 0) {
+      ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+static double per_kilo_instruction(const double* count,
+                                   const enum CounterEvent e) {
+  if (count[e] < 0 || count[COUNTER_INSTRUCTIONS] <= 0) return -1;
+  return count[e] * 1000 / count[COUNTER_INSTRUCTIONS];
+}
+
+void perf_counters_close(struct PerfCounters* pc, struct Counters* counters) {
+  int e;
+  double* count = counters->count;
+  counters->available = 0;
+  for (e = 0; e < NUM_COUNTER_EVENTS; e++) {
+    if (pc->fd[e] >= 0 && pc->runs > 0) {
+      count[e] = pc->total[e] / pc->runs;
+      counters->available = 1;
+      close(pc->fd[e]);
+    } else {
+      count[e] = -1;
+    }
+    pc->fd[e] = -1;
+  }
+
+  counters->ipc = (count[COUNTER_INSTRUCTIONS] >= 0 &&
+                   count[COUNTER_CYCLES] > 0) ?
+      count[COUNTER_INSTRUCTIONS] / count[COUNTER_CYCLES] : -1;
+  counters->branch_mpki = per_kilo_instruction(count, COUNTER_BRANCH_MISSES);
+  counters->branch_miss_rate = (count[COUNTER_BRANCH_MISSES] >= 0 &&
+                                count[COUNTER_BRANCHES] > 0) ?
+      count[COUNTER_BRANCH_MISSES] / count[COUNTER_BRANCHES] : -1;
+  counters->l1d_mpki = per_kilo_instruction(count, COUNTER_L1D_MISSES);
+  counters->llc_mpki = per_kilo_instruction(count, COUNTER_LLC_MISSES);
+  counters->dtlb_mpki = per_kilo_instruction(count, COUNTER_DTLB_MISSES);
+  counters->itlb_mpki = per_kilo_instruction(count, COUNTER_ITLB_MISSES);
+}
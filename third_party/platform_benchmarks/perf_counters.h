@@ -0,0 +1,48 @@
+/*
+ * Copyright 2018 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLATFORMS_BENCHMARKS_MICROBENCHMARKS_PERF_COUNTERS_H_
+#define PLATFORMS_BENCHMARKS_MICROBENCHMARKS_PERF_COUNTERS_H_
+
+#include "result.h"
+
+// Counts the events in enum CounterEvent for the calling thread with
+// perf_event_open. Events are opened individually rather than as one group
+// so that a PMU with few counters, or a VM that only exposes some of them,
+// still gives us whatever it can (scaled for multiplexing).
+struct PerfCounters {
+  int fd[NUM_COUNTER_EVENTS];
+  double total[NUM_COUNTER_EVENTS];
+  int runs;
+};
+
+// Returns number of events that could be opened, 0 if counters are
+// unavailable (no PMU, perf_event_paranoid, seccomp etc).
+int perf_counters_open(struct PerfCounters* pc);
+
+// Brackets one timed run. Counts are accumulated across runs.
+void perf_counters_start(struct PerfCounters* pc);
+void perf_counters_stop(struct PerfCounters* pc);
+
+// Within a run, stop and carry on counting without resetting, to leave parts
+// of it out.
+void perf_counters_pause(struct PerfCounters* pc);
+void perf_counters_resume(struct PerfCounters* pc);
+
+// Per run averages and derived metrics. Closes the counters.
+void perf_counters_close(struct PerfCounters* pc, struct Counters* counters);
+
+#endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_PERF_COUNTERS_H_
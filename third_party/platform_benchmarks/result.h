@@ -22,11 +22,52 @@
 #define FN_NAME_LENGTH 100
 #define METRIC_NAME_LENGTH 100
 
+// Hardware events counted around a test by perf_counters.h.
+enum CounterEvent {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_BRANCHES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_L1D_MISSES,
+  COUNTER_LLC_MISSES,
+  COUNTER_DTLB_MISSES,
+  COUNTER_ITLB_MISSES,
+  NUM_COUNTER_EVENTS,
+};
+
+struct Counters {
+  // 0 if counting wasn't requested or no event could be opened.
+  int available;
+
+  // Per run of the test. Negative if that event couldn't be counted.
+  double count[NUM_COUNTER_EVENTS];
+
+  // Derived from count[], negative if an input is missing.
+  double ipc;
+  double branch_mpki;
+  double branch_miss_rate;  // Equals BTB miss rate for btb_capacity.
+  double l1d_mpki;
+  double llc_mpki;
+  double dtlb_mpki;
+  double itlb_mpki;
+};
+
 struct Result {
   char function[FN_NAME_LENGTH];
   int64_t resulthash;
   double metric;
   char metricname[METRIC_NAME_LENGTH];
+
+  // Spread of metric over repeated runs. Filled in by summarize_samples(),
+  // tests only need to set metric.
+  int repetitions;
+  double min;
+  double median;
+  double p90;
+  double max;
+  double stddev;
+
+  struct Counters counters;
 };
 
 #endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_RESULT_H_
@@ -14,6 +14,14 @@
  * limitations under the License.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <math.h>
+#include <sys/mman.h>
+
+#include "result.h"
 #include "util.h"
 
 void byte2string(char* str, const unsigned logbytes) {
@@ -32,6 +40,66 @@ void byte2string(char* str, const unsigned logbytes) {
   snprintf(str, MAX_BYTE_STRING_LENGTH, "%u %s", num, sizestr);
 }
 
+void size2string(char* str, const uint64_t bytes) {
+  if (bytes >= (1llu << 30)) {
+    snprintf(str, MAX_BYTE_STRING_LENGTH, "%g GB", (double)bytes / (1llu << 30));
+  } else if (bytes >= (1llu << 20)) {
+    snprintf(str, MAX_BYTE_STRING_LENGTH, "%g MB", (double)bytes / (1llu << 20));
+  } else if (bytes >= (1llu << 10)) {
+    snprintf(str, MAX_BYTE_STRING_LENGTH, "%g KB", (double)bytes / (1llu << 10));
+  } else {
+    snprintf(str, MAX_BYTE_STRING_LENGTH, "%llu bytes", (unsigned long long)bytes);
+  }
+}
+
+static __thread int reuse_buffers;
+
+void set_buffer_reuse(const int reuse) {
+  reuse_buffers = reuse;
+}
+
+int buffer_reuse(void) {
+  return reuse_buffers;
+}
+
+static __thread void (*region_begin)(void*);
+static __thread void (*region_end)(void*);
+static __thread void* region_arg;
+
+void set_timed_region_hooks(void (*begin)(void*), void (*end)(void*),
+                            void* arg) {
+  region_begin = begin;
+  region_end = end;
+  region_arg = arg;
+}
+
+void timed_region_begin(void) {
+  if (region_begin != NULL) region_begin(region_arg);
+}
+
+void timed_region_end(void) {
+  if (region_end != NULL) region_end(region_arg);
+}
+
+static void (*point_emitter)(const struct Result*, void*);
+static void* point_emitter_arg;
+
+void set_point_emitter(void (*emit)(const struct Result*, void*), void* arg) {
+  point_emitter = emit;
+  point_emitter_arg = arg;
+}
+
+void emit_point(const struct Result* point) {
+  if (point_emitter != NULL) {
+    point_emitter(point, point_emitter_arg);
+  } else {
+    printf("%s\tresulthash=%llx\t%s=%.6f\n", point->function,
+           (unsigned long long)point->resulthash, point->metricname,
+           point->metric);
+  }
+  fflush(stdout);
+}
+
 void* randmemset(void *s, size_t n, unsigned randseed) {
   size_t i;
   char* p = (char *)s;
@@ -40,3 +108,129 @@ void* randmemset(void *s, size_t n, unsigned randseed) {
   }
   return s;
 }
+
+static int compare_doubles(const void* a, const void* b) {
+  const double x = *(const double*)a;
+  const double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Linear interpolation between closest ranks of sorted samples.
+static double percentile(const double* sorted, const int n, const double q) {
+  const double rank = q * (n - 1);
+  const int lo = (int)rank;
+  if (lo + 1 >= n) return sorted[n - 1];
+  return sorted[lo] + (rank - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+void summarize_samples(double* samples, const int n, struct Result* result) {
+  int i;
+  double mean = 0;
+  double variance = 0;
+
+  qsort(samples, n, sizeof(double), compare_doubles);
+  for (i = 0; i < n; i++) {
+    mean += samples[i] / n;
+  }
+  for (i = 0; i < n; i++) {
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  }
+
+  result->repetitions = n;
+  result->min = samples[0];
+  result->median = percentile(samples, n, 0.5);
+  result->p90 = percentile(samples, n, 0.9);
+  result->max = samples[n - 1];
+  result->stddev = n > 1 ? sqrt(variance / (n - 1)) : 0;
+}
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define HUGE_2MB (1llu << 21)
+#define HUGE_1GB (1llu << 30)
+
+static size_t page_size_for(const int page_mode) {
+  switch (page_mode) {
+    case PAGES_THP:
+    case PAGES_HUGETLB_2MB:
+      return HUGE_2MB;
+    case PAGES_HUGETLB_1GB:
+      return HUGE_1GB;
+    default:
+      return 4096;
+  }
+}
+
+static size_t round_to_page(const size_t bytes, const int page_mode) {
+  const size_t page = page_size_for(page_mode);
+  return (bytes + page - 1) & ~(page - 1);
+}
+
+void* alloc_pages(const size_t bytes, const int page_mode) {
+  const size_t len = round_to_page(bytes, page_mode);
+  char* p;
+
+  switch (page_mode) {
+    case PAGES_4KB:
+      p = (char*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) return NULL;
+      madvise(p, len, MADV_NOHUGEPAGE);
+      return p;
+
+    case PAGES_THP: {
+      // Over-allocate so we can trim to a 2MB aligned range, otherwise the
+      // first and last partial 2MB can't be backed by a huge page.
+      char* raw = (char*)mmap(NULL, len + HUGE_2MB, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) return NULL;
+      p = (char*)(((uint64_t)raw + HUGE_2MB - 1) & ~(HUGE_2MB - 1));
+      if (p != raw) munmap(raw, p - raw);
+      munmap(p + len, raw + HUGE_2MB - p);
+      if (madvise(p, len, MADV_HUGEPAGE) != 0) {
+        munmap(p, len);
+        return NULL;
+      }
+      return p;
+    }
+
+    case PAGES_HUGETLB_2MB:
+    case PAGES_HUGETLB_1GB:
+      p = (char*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                      (page_mode == PAGES_HUGETLB_2MB ?
+                       MAP_HUGE_2MB : MAP_HUGE_1GB),
+                      -1, 0);
+      return p == MAP_FAILED ? NULL : p;
+
+    default:
+      return NULL;
+  }
+}
+
+void free_pages(void* p, const size_t bytes, const int page_mode) {
+  munmap(p, round_to_page(bytes, page_mode));
+}
+
+const char* page_mode_string(const int page_mode) {
+  switch (page_mode) {
+    case PAGES_4KB:
+      return "4KB pages";
+    case PAGES_THP:
+      return "THP";
+    case PAGES_HUGETLB_2MB:
+      return "2MB hugetlb";
+    case PAGES_HUGETLB_1GB:
+      return "1GB hugetlb";
+    default:
+      return "unknown pages";
+  }
+}
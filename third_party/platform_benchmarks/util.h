@@ -58,9 +58,21 @@
 #define MAX_CACHELINE_SIZE 0x80  // 128-byte cacheline max.
 
 #define MAX_BYTE_STRING_LENGTH 100
+// byte2string() and size2string() write no more characters than this (eg:
+// "1.79769e+308 GB"). Names that embed them print them with "%.*s" and this,
+// so that the compiler can tell the name fits.
+#define BYTE_STRING_CHARS 16
 
 #define RAND_BUF_SIZE 32
 
+// Page backing for alloc_pages().
+#define PAGES_4KB 0          // Base pages, transparent huge pages disabled.
+#define PAGES_THP 1          // 2MB aligned, madvise(MADV_HUGEPAGE).
+#define PAGES_HUGETLB_2MB 2  // MAP_HUGETLB, needs reserved 2MB hugepages.
+#define PAGES_HUGETLB_1GB 3  // MAP_HUGETLB, needs reserved 1GB hugepages.
+
+struct Result;
+
 static inline uint64_t now_nsec(void) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -68,6 +80,41 @@ static inline uint64_t now_nsec(void) {
 }
 
 void byte2string(char* str, const unsigned logbytes);
+// Like byte2string for sizes that need not be a power of 2 (eg: "1.5 MB").
+void size2string(char* str, const uint64_t bytes);
 void* randmemset(void *s, size_t n, unsigned randseed);
 
+// mmaps bytes (rounded up to the page size) backed by pages of page_mode.
+// Returns NULL if that kind of page isn't available.
+void* alloc_pages(const size_t bytes, const int page_mode);
+void free_pages(void* p, const size_t bytes, const int page_mode);
+const char* page_mode_string(const int page_mode);
+
+// Sweeps run one test at many sizes in a row on one thread. While buffer reuse
+// is on for the calling thread, tests keep their large buffers from one call
+// to the next instead of allocating them per call. It is off by default, so
+// the worker threads of multi-threaded runs always get private buffers.
+void set_buffer_reuse(const int reuse);
+int buffer_reuse(void);
+
+// Tests call timed_region_begin() and timed_region_end() right around their
+// timed loop, so that a driver can measure just that (eg: with hardware
+// counters) rather than the setup around it. Both do nothing unless the
+// calling thread installed hooks with set_timed_region_hooks().
+void set_timed_region_hooks(void (*begin)(void*), void (*end)(void*),
+                            void* arg);
+void timed_region_begin(void);
+void timed_region_end(void);
+
+// Tests that measure a curve or matrix (eg: latency at every footprint) report
+// each point as a result of its own with emit_point(), so that points come out
+// in the same format as the final result. Without an emitter installed with
+// set_point_emitter(), points print as text.
+void set_point_emitter(void (*emit)(const struct Result*, void*), void* arg);
+void emit_point(const struct Result* point);
+
+// Sorts the n samples of a metric in place, and sets the min, median, p90,
+// max and stddev fields of result from them.
+void summarize_samples(double* samples, const int n, struct Result* result);
+
 #endif  // PLATFORMS_BENCHMARKS_MICROBENCHMARKS_UTIL_H_
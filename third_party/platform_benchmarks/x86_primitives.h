@@ -24,7 +24,7 @@
                       preamble,                                         \
                       asmbody,                                          \
                       postamble)                                        \
-  asm(preamble                                                          \
+  asm volatile(preamble                                                 \
       "add $0, %[loop_counter]\n\t"                                     \
       ".align 64\n\t"                                                   \
       "1: jz 1f\n\t"                                                    \